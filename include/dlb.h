@@ -16,6 +16,10 @@
 #endif
 
 #ifdef DLBLIB
+#if defined(UNIX) && !defined(NO_DLBMMAP)
+#define DLBMMAP /* read libraries through a shared read-only mapping */
+#endif
+
 /* directory structure in memory */
 typedef struct dlb_directory {
     char *fname;   /* file name as seen from calling code */
@@ -33,6 +37,10 @@ typedef struct dlb_library {
     long nentries; /* # of files in directory */
     long rev;      /* dlb file revision */
     long strsize;  /* dlb file string size */
+#ifdef DLBMMAP
+    char *mdata;   /* the whole file, mapped; null to read it with stdio */
+    long msize;    /* size of the mapping */
+#endif
 } library;
 
 /* library definitions */
@@ -77,6 +85,8 @@ typedef struct dlb_handle {
 
 boolean NDECL(dlb_init);
 void NDECL(dlb_cleanup);
+void NDECL(dlb_unshare);
+void FDECL(dlb_foreach, (void FDECL((*), (const char *))));
 
 dlb *FDECL(dlb_fopen, (const char *, const char *));
 int FDECL(dlb_fclose, (DLB_P));
@@ -105,6 +115,8 @@ long rsrc_dlb_ftell(dlb *dp);
 
 #define dlb_init()
 #define dlb_cleanup()
+#define dlb_unshare()
+#define dlb_foreach(fn)
 
 #define dlb_fopen fopen
 #define dlb_fclose fclose
@@ -842,6 +842,10 @@ E boolean NDECL(recover_savefile);
 E void NDECL(assure_syscf_file);
 #endif
 E int FDECL(nhclose, (int));
+E int FDECL(nhread, (int, genericptr_t, unsigned));
+#ifdef UNIX
+E FILE *FDECL(levelfile_stream, (int));
+#endif
 #ifdef HOLD_LOCKFILE_OPEN
 E void NDECL(really_close);
 #endif
@@ -1210,6 +1214,11 @@ E boolean FDECL(usmellmon, (struct permonst *));
 /* ### mapglyph.c ### */
 
 E int FDECL(mapglyph, (int, int *, int *, unsigned *, int, int, unsigned));
+E void FDECL(map_glyphcell, (int, int *, int *, unsigned *, int, int));
+E void FDECL(map_glyphcells, (const short *, uchar *, uchar *, uchar *));
+#ifdef EXTRA_SANITY_CHECKS
+E int NDECL(glyphmap_mismatches);
+#endif
 E char *FDECL(encglyph, (int));
 E char *FDECL(decode_mixed, (char *, const char *));
 E void FDECL(genl_putmixed, (winid, int, const char *));
@@ -1782,6 +1791,7 @@ E char FDECL(map_menu_cmd, (CHAR_P));
 E void FDECL(show_menu_controls, (winid, BOOLEAN_P));
 E void FDECL(assign_warnings, (uchar *));
 E char *FDECL(nh_getenv, (const char *));
+E char *FDECL((*nh_getenv_hook), (const char *));
 E void FDECL(set_duplicate_opt_detection, (int));
 E void FDECL(set_wc_option_mod_status, (unsigned long, int));
 E void FDECL(set_wc2_option_mod_status, (unsigned long, int));
@@ -2152,6 +2162,8 @@ E void FDECL(genl_outrip, (winid, int, time_t));
 #ifdef USE_ISAAC64
 E void FDECL(init_isaac64, (unsigned long, int FDECL((*fn), (int))));
 E long NDECL(nhrand);
+E void FDECL(save_rngs, (int));
+E void FDECL(rest_rngs, (int));
 #endif
 E int FDECL(rn2, (int));
 E int FDECL(rn2_on_display_rng, (int));
@@ -2211,6 +2223,7 @@ E void NDECL(rumor_check);
 
 E int NDECL(dosave);
 E int NDECL(dosave0);
+E int FDECL(savesnapshot, (int));
 E boolean FDECL(tricked_fileremoved, (int, char *));
 #ifdef INSURANCE
 E void NDECL(savestateinlock);
@@ -2366,6 +2379,8 @@ E boolean
 FDECL(dig_corridor, (coord *, coord *, BOOLEAN_P, SCHAR_P, SCHAR_P));
 E void FDECL(fill_room, (struct mkroom *, BOOLEAN_P));
 E boolean FDECL(load_special, (const char *));
+E void NDECL(preload_special);
+E void NDECL(free_special_levels);
 E xchar FDECL(selection_getpoint, (int, int, struct opvar *));
 E struct opvar *FDECL(selection_opvar, (char *));
 E void FDECL(opvar_free_x, (struct opvar *));
@@ -2589,9 +2604,14 @@ E void FDECL(light_hits_gremlin, (struct monst *, int));
 E void NDECL(port_help);
 #endif
 E void FDECL(sethanguphandler, (void (*)(int)));
+E void FDECL(append_slash, (char *));
 E boolean NDECL(authorize_wizard_mode);
 E boolean FDECL(check_user_string, (char *));
 E char *NDECL(get_login_name);
+#ifndef NLE_LIB
+E int FDECL(nle_control, (int));
+E void FDECL(nle_reuse_next, (int));
+#endif
 #endif /* UNIX */
 
 /* ### unixtty.c ### */
@@ -271,6 +271,7 @@ struct instance_flags {
     boolean in_parse;      /* is a command being parsed? */
      /* suppress terminate during options parsing, for --showpaths */
     boolean initoptions_noterminate;
+    boolean diskless;      /* NLE: no files written, see NLE_DISKLESS */
 
     /* stuff that is related to options and/or user or platform preferences
      */
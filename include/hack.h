@@ -72,6 +72,7 @@ enum dismount_types {
 /* mgflags for mapglyph() */
 #define MG_FLAG_NORMAL     0x00
 #define MG_FLAG_NOOVERRIDE 0x01
+#define MG_FLAG_NOPOS      0x02 /* ignore x, y: not the hero, no pile */
 
 /* Special returns from mapglyph() */
 #define MG_CORPSE  0x01
@@ -0,0 +1,70 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+#ifndef NLE_H
+#define NLE_H
+
+#include <stdio.h>
+
+#include "nleobs.h"
+
+/*
+ * In-process NetHack, built as libnethack.so.
+ *
+ * nle_start() runs a new game until NetHack first asks for a key and fills
+ * in the observation.  Each nle_step() hands obs->action to the game and
+ * returns once NetHack asks for the next key.  nle_end() stops the game if
+ * it is still running and releases it.  NetHack keeps its state in global
+ * variables, so a loaded copy of the library runs one game at a time.
+ *
+ * If ttyrec is not NULL, the tty output of the game is written to it in the
+ * same ttyrec2 format the Python process backend records.
+ */
+
+/* Size of the (virtual) terminal the tty window port draws on. */
+#define NLE_TERM_LI 24
+#define NLE_TERM_CO 80
+
+typedef struct nle_settings {
+    const char *hackdir;    /* playground: nhdat, record, level files, ... */
+    const char *options;    /* NETHACKOPTIONS */
+    const char *playername; /* like nethack -u */
+    unsigned long seeds[2]; /* core, disp; 0 lets NetHack pick one */
+    int diskless;           /* no files written, see NLE_DISKLESS */
+} nle_settings;
+
+typedef struct nle_globals nle_ctx_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+nle_ctx_t *nle_start(nle_settings *, nle_obs *, FILE *);
+nle_ctx_t *nle_step(nle_ctx_t *, nle_obs *);
+void nle_end(nle_ctx_t *);
+
+/* Serialized Message flatbuffer of the last step; valid until the next. */
+const void *nle_get_message(nle_ctx_t *, size_t *);
+
+#ifdef EXTRA_SANITY_CHECKS
+/* How many glyphs the window port's glyph table maps wrong; for tests. */
+int nle_check_glyphmap(nle_ctx_t *);
+#endif
+
+/* Used by the window ports when built with NLE_LIB. */
+int nle_getch(void);
+nle_obs *nle_get_obs(void);
+void nle_set_message(const void *, size_t);
+void nethack_exit(int);
+
+/* The rl window port's; nle_end() calls it to free what outlives a game. */
+void nle_rl_free(void);
+
+int nle_putchar(int);
+int nle_puts(const char *);
+int nle_fputs(const char *, FILE *);
+int nle_fflush(FILE *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NLE_H */
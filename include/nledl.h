@@ -0,0 +1,72 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+#ifndef NLEDL_H
+#define NLEDL_H
+
+#include "nle.h"
+
+/*
+ * Many games in one process.
+ *
+ * NetHack keeps all of its state (u, level, invent, moves, the RNGs, the
+ * window ports, ...) in global variables, and so does a loaded copy of
+ * libnethack.so.  Each nledl_ctx therefore gets a private copy of the
+ * library file: the copy's globals are the game's context.  The first
+ * nledl_start() loads the copy and saves its writable segment; later ones
+ * copy that back over the previous game's globals instead of reloading the
+ * library, so it is never re-initialized by hand.  Where the segment can't
+ * be found (not ELF), the copy is reloaded for each game instead.
+ *
+ * The copies are files in $TMPDIR.  Once loaded for good, a copy is
+ * unlinked; where it is reloaded for each game, it stays until
+ * nledl_close().  As ld.so maps each copy on its own, contexts don't share
+ * the library's text either: each one costs the size of libnethack.so in
+ * page cache and resident memory, on top of its globals.
+ *
+ * For this, a game must leave nothing behind in its globals that the next
+ * one could trip over: NetHack frees its data when the game ends
+ * (freedynamicdata()) and nle_end() has the rl window port free its own.
+ * Nor may the saved globals hold anything allocated when the copy was
+ * loaded, as every later game would get those same pointers back: the rl
+ * port's globals are plain data, or created by the game that uses them,
+ * never by a C++ constructor at dlopen().  The one exception is the
+ * special levels the copy has loaded (sp_lev.c): they never change, so
+ * they are kept for the next game and only freed when the copy is
+ * unloaded.
+ *
+ * Contexts share nothing and may be stepped from different threads, as
+ * long as each one is only used by one thread at a time.  Each context
+ * needs its own settings->hackdir, as NetHack's lock file is named after
+ * the process, unless settings->diskless leaves it in memory.
+ */
+
+typedef struct nledl_ctx nledl_ctx;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* dlpath is the libnethack.so to copy; nothing is loaded until started. */
+nledl_ctx *nledl_open(const char *dlpath);
+
+/* Starts a new game, ending the previous one.  Returns 0 on success. */
+int nledl_start(nledl_ctx *, nle_settings *, nle_obs *, FILE *ttyrec);
+void nledl_step(nledl_ctx *, nle_obs *);
+const void *nledl_get_message(nledl_ctx *, size_t *);
+/* nle_check_glyphmap(); -1 without a game, or if the library wasn't
+   built with EXTRA_SANITY_CHECKS. */
+int nledl_check_glyphmap(nledl_ctx *);
+
+/* Ends the game, if any; the copy stays loaded for the next one. */
+void nledl_end(nledl_ctx *);
+
+/* nledl_end(), then unloads and removes the context's copy. */
+void nledl_close(nledl_ctx *);
+
+/* Why the last nledl_start() failed. */
+const char *nledl_error(nledl_ctx *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NLEDL_H */
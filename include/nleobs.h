@@ -0,0 +1,75 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+#ifndef NLEOBS_H
+#define NLEOBS_H
+
+/*
+ * Fixed-layout observation filled in by the rl window port when NetHack runs
+ * inside another program (see nle.h).  The struct is plain old data so that
+ * callers can wrap its fields without copying, e.g. as numpy arrays.
+ *
+ * This header is shared with C++ and must not depend on hack.h; winrl.cc
+ * checks the sizes below against NetHack's own constants.
+ */
+
+#define NLE_MAP_ROWS 21 /* ROWNO */
+#define NLE_MAP_COLS 79 /* COLNO - 1 */
+
+/* Most cells of nle_obs.glyphs_crop, enough for 21 by 21: the glyphs
+   around the hero, as many rows and columns of them as NLE_GLYPHS_CROP
+   says (see winrl.cc), are the first ones, row by row.  Not the whole map,
+   which glyphs already is, as every shm slot carries them. */
+#define NLE_CROP_SIZE (NLE_MAP_ROWS * NLE_MAP_ROWS)
+
+/* Indices into nle_obs.blstats; same order as the Blstats flatbuffer. */
+#define NLE_BL_X 0
+#define NLE_BL_Y 1
+#define NLE_BL_STR25 2
+#define NLE_BL_STR125 3
+#define NLE_BL_DEX 4
+#define NLE_BL_CON 5
+#define NLE_BL_INT 6
+#define NLE_BL_WIS 7
+#define NLE_BL_CHA 8
+#define NLE_BL_SCORE 9
+#define NLE_BL_HP 10
+#define NLE_BL_HPMAX 11
+#define NLE_BL_DEPTH 12
+#define NLE_BL_GOLD 13
+#define NLE_BL_ENE 14
+#define NLE_BL_ENEMAX 15
+#define NLE_BL_AC 16
+#define NLE_BL_HD 17
+#define NLE_BL_XP 18
+#define NLE_BL_EXP 19
+#define NLE_BL_TIME 20
+#define NLE_BL_HUNGER 21
+#define NLE_BL_CAP 22
+#define NLE_BLSTATS_SIZE 23
+
+/* Text of the message window, one NUL after each line, zero padded. */
+#define NLE_MESSAGE_SIZE 256
+
+/* Inventory: glyphs are padded with NO_GLYPH, object classes with
+   MAXOCLASSES, strings and letters with zeros. */
+#define NLE_INVENTORY_SIZE 55
+#define NLE_INVENTORY_STR_LENGTH 80
+
+typedef struct nle_observation {
+    int action;      /* in: key to send to NetHack on the next step */
+    int done;        /* out: NetHack has exited */
+    int in_moveloop; /* out: program_state.in_moveloop */
+    int xwaitforspace; /* out: tty waits for --More-- to be dismissed */
+    short glyphs[NLE_MAP_ROWS][NLE_MAP_COLS];
+    unsigned char chars[NLE_MAP_ROWS][NLE_MAP_COLS];
+    unsigned char colors[NLE_MAP_ROWS][NLE_MAP_COLS];
+    unsigned char specials[NLE_MAP_ROWS][NLE_MAP_COLS];
+    short glyphs_crop[NLE_CROP_SIZE];
+    int blstats[NLE_BLSTATS_SIZE];
+    unsigned char message[NLE_MESSAGE_SIZE];
+    short inv_glyphs[NLE_INVENTORY_SIZE];
+    unsigned char inv_strs[NLE_INVENTORY_SIZE][NLE_INVENTORY_STR_LENGTH];
+    unsigned char inv_letters[NLE_INVENTORY_SIZE];
+    unsigned char inv_oclasses[NLE_INVENTORY_SIZE];
+} nle_obs;
+
+#endif /* NLEOBS_H */
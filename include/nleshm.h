@@ -0,0 +1,51 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+#ifndef NLESHM_H
+#define NLESHM_H
+
+#include <stdint.h>
+
+#include "nleobs.h"
+
+/*
+ * Shared-memory transport between a nethack process and its parent.
+ *
+ * The parent creates a memory file of sizeof(nle_shm) bytes (memfd, or an
+ * unlinked file in /dev/shm where there is no memfd), maps it, and starts
+ * nethack with NLE_SHM set to its fd and NLE_SHM_NOTIFY to the write end of
+ * a pipe; nothing of the ring is ever written back to disk.  Whenever
+ * NetHack asks for a key the rl window port fills the next slot of the
+ * ring with the observation and the Message flatbuffer, bumps seq and
+ * writes one byte to the pipe.  The parent wakes up on that byte and reads
+ * slot (seq - 1) % NLE_SHM_SLOTS in place; older slots stay untouched for
+ * NLE_SHM_SLOTS - 1 more observations, so the previous step's data can be
+ * used without copying it.
+ *
+ * If NLE_SHM_ACTION is set too, it is the read end of a second pipe that
+ * the parent writes each key to, one byte per key.  Keys then bypass the
+ * pty and its line discipline; a step is one write and one read.
+ *
+ * NLE_CONTROL, if set as well, is a datagram socket for requests the game
+ * serves while it waits for a key: copies of the game, each with a ring
+ * and pipes of its own that starts by sending the observation the game is
+ * waiting on, and snapshots in save file format.  See nle_control() in
+ * sys/unix/unixmain.c.
+ */
+
+#define NLE_SHM_MAGIC 0x534d484eU /* "NHMS" */
+#define NLE_SHM_SLOTS 4
+#define NLE_SHM_MESSAGE_MAX (1 << 20) /* only touched pages use memory */
+
+typedef struct nle_shm_slot {
+    nle_obs obs;
+    uint32_t message_size;
+    unsigned char message[NLE_SHM_MESSAGE_MAX]; /* Message flatbuffer */
+} nle_shm_slot;
+
+typedef struct nle_shm {
+    uint32_t magic; /* set by nethack once it mapped the ring */
+    uint32_t slots;
+    uint64_t seq; /* observations written so far */
+    nle_shm_slot slot[NLE_SHM_SLOTS];
+} nle_shm;
+
+#endif /* NLESHM_H */
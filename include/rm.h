@@ -308,6 +308,7 @@ extern const struct symdef defsyms[MAXPCHARS]; /* defaults */
 extern const struct symdef def_warnsyms[WARNCOUNT];
 extern int currentgraphics; /* from drawing.c */
 extern nhsym showsyms[];
+extern boolean showsyms_changed; /* glyphmap in mapglyph.c is stale */
 extern nhsym primary_syms[];
 extern nhsym rogue_syms[];
 extern nhsym ov_primary_syms[];
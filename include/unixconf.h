@@ -425,5 +425,23 @@
 # endif
 #endif
 
+/*
+ * LEVELS_IN_MEMORY keeps levels other than the lock file in memory rather
+ * than in level files (see files.c), as the NLE hints files set.  Nothing
+ * is left to recover a crashed game from then, so INSURANCE goes.
+ */
+#ifdef LEVELS_IN_MEMORY
+# undef INSURANCE
+#endif
+
+/*
+ * LEVELS_IN_MEMORY keeps levels other than the lock file in memory rather
+ * than in level files (see files.c); the NLE hints files set it.  There is
+ * nothing to recover a crashed game from then, so no INSURANCE either.
+ */
+#ifdef LEVELS_IN_MEMORY
+# undef INSURANCE
+#endif
+
 #endif /* UNIXCONF_H */
 #endif /* UNIX */
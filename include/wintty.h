@@ -266,6 +266,18 @@ E void FDECL(video_update_positionbar, (char *));
 #endif /*MSDOS*/
 #endif /*NO_TERMS*/
 
+#ifdef NLE_LIB
+/* in-process library: tty output goes to the game's ttyrec (see nle.c) */
+#include "nle.h"
+#ifdef putchar
+#undef putchar
+#endif
+#define putchar nle_putchar
+#define puts nle_puts
+#define fputs nle_fputs
+#define fflush nle_fflush
+#endif /* NLE_LIB */
+
 #undef E
 
 #endif /* WINTTY_H */
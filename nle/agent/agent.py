@@ -137,8 +137,15 @@ def compute_policy_gradient_loss(logits, actions, advantages):
     return torch.sum(cross_entropy * advantages.detach())
 
 
-def create_env(name, *args, **kwargs):
-    return gym.make(name, observation_keys=("glyphs", "status"), *args, **kwargs)
+def create_env(name, *args, crop_dim=9, **kwargs):
+    # NetHackNet's crop_dim must match, see the assert there.
+    return gym.make(
+        name,
+        observation_keys=("glyphs", "glyphs_crop", "status"),
+        glyphs_crop=(crop_dim, crop_dim),
+        *args,
+        **kwargs
+    )
 
 
 def act(
@@ -324,7 +331,7 @@ def create_buffers(flags, observation_space, num_actions, num_overlapping_steps=
     return buffers
 
 
-def _format_observations(observation, keys=("glyphs", "status")):
+def _format_observations(observation, keys=("glyphs", "glyphs_crop", "status")):
     observations = {}
     for key in keys:
         entry = observation[key]
@@ -740,6 +747,8 @@ class NetHackNet(nn.Module):
         self.h_dim = 512
 
         self.crop_dim = crop_dim
+        if "glyphs_crop" in observation_shape:
+            assert observation_shape["glyphs_crop"].shape == (crop_dim, crop_dim)
 
         self.crop = Crop(self.H, self.W, self.crop_dim, self.crop_dim)
 
@@ -866,7 +875,12 @@ class NetHackNet(nn.Module):
         reps = [status_emb]
 
         # -- [B x H' x W']
-        crop = self.crop(glyphs, coordinates)
+        if "glyphs_crop" in env_outputs:
+            # Cropped by NetHack already, see NLE_GLYPHS_CROP. Off the map
+            # that is solid rock's glyph, where Crop pads with 0.
+            crop = torch.flatten(env_outputs["glyphs_crop"], 0, 1).long()
+        else:
+            crop = self.crop(glyphs, coordinates)
 
         # print("crop", crop)
         # print("at_xy", glyphs[:, coordinates[:, 1].long(), coordinates[:, 0].long()])
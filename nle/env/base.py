@@ -2,7 +2,9 @@
 import collections
 import csv
 import enum
+import functools
 import logging
+import operator
 import os
 import random
 import re
@@ -33,21 +35,6 @@ FINAL_QUESTIONS = re.compile(
 DUNGEON_SHAPE = (21, 79)
 
 
-def _fb_ndarray_to_np(fb_ndarray):
-    result = fb_ndarray.DataAsNumpy()
-    result = result.view(np.typeDict[fb_ndarray.Dtype()])
-    result = result.reshape(fb_ndarray.ShapeAsNumpy().tolist())
-    return result
-
-
-INVFIELDS = [
-    "Glyph",
-    "Str",
-    "Letter",
-    "ObjectClass",
-    # "ObjectClassName",
-]
-
 DEFAULT_MSG_PAD = 256
 DEFAULT_INV_PAD = 55
 DEFAULT_INVSTR_PAD = 80
@@ -81,89 +68,11 @@ def _get(response, path="Blstats.score", default=None, required=False):
     return node
 
 
-def _get_glyphs(response):
-    if response is None:
-        return np.zeros(DUNGEON_SHAPE, dtype=np.int16)
-    o = response.Observation()
-    # If done is True, Observation() is None.
-    if o is None:
-        return np.zeros(DUNGEON_SHAPE, dtype=np.int16)
-    return o.Glyphs().DataAsNumpy().view(np.int16).reshape(DUNGEON_SHAPE)
-
-
-def _get_status_fast(response, entries=23):
-    # Fast version of _get_status. See that function for the order.
-    s = response.Blstats()
-    if s is None:
-        return np.zeros(entries, dtype=np.int32)
-    return np.frombuffer(
-        s._tab.Bytes[s._tab.Pos : s._tab.Pos + 4 * entries], dtype=np.int32
-    )
-
-
-def _get_status(response):
-    s = response.Blstats()
-    if s is None:
-        return np.zeros(23, dtype=np.int32)
-
-    return np.array(
-        (
-            s.CursX(),
-            s.CursY(),
-            # 1..125. See
-            # https://nethackwiki.com/wiki/Attribute#Strength_in_game_formulas
-            # and get_strength_str() in botl.c
-            s.StrengthPercentage(),
-            s.Strength(),
-            s.Dexterity(),
-            s.Constitution(),
-            s.Intelligence(),
-            s.Wisdom(),
-            s.Charisma(),
-            s.Score(),
-            s.Hitpoints(),
-            s.MaxHitpoints(),
-            s.Depth(),
-            s.Gold(),
-            s.Energy(),
-            s.MaxEnergy(),
-            s.ArmorClass(),
-            s.MonsterLevel(),
-            s.ExperienceLevel(),
-            s.ExperiencePoints(),
-            s.Time(),
-            s.HungerState(),
-            s.CarryingCapacity(),
-        ),
-        dtype=np.int32,
-    )
-
-
-def _get_padded_message(
-    response, padded_length=DEFAULT_MSG_PAD, alphabet_size=ord("~") - ord(" ") + 1
-):
-    # TODO: This would be faster if done in C++.
-    result = np.full(padded_length, fill_value=alphabet_size, dtype=np.uint8)
-    if response is None or response.NotRunning():
-        return result
-
-    win = response.Windows(WIN_MESSAGE)
-    if win is None:
-        logger.error("No message window. This shouldn't happen.")
-        return result
-
-    assert win.Type() == nethack.NHW_MESSAGE
-
-    offset = 0
-    for i in range(win.StringsLength()):
-        message = np.frombuffer(win.Strings(i), dtype=np.uint8)
-
-        # Subtract ord(" ") and assign. Crop if space runs out.
-        result[offset : offset + len(message)] = (
-            message[: max(len(result) - offset, 0)] - 0x20
-        )
-        offset += len(message) + 1  # Keep one separation token.
-    return result
+def _view_glyphs_crop(shape, observation, copy=False):
+    # Flat in nle_obs, with the crop in front; already shaped when decoded.
+    n = shape[0] * shape[1]
+    crop = observation["glyphs_crop"].reshape(-1)[:n].reshape(shape)
+    return crop.copy() if copy else crop
 
 
 def _wait_for_space(response):
@@ -183,56 +92,65 @@ def _get_call_stack(response):
     return (internal.CallStack(i) for i in range(internal.CallStackLength()))
 
 
-def _get_inv(response):
-    result = {}
-    for field in INVFIELDS:
-        result[field] = []
-
-    o = response.Observation()
-    if o is None:
-        return result
-
-    for item in (o.Inventory(i) for i in range(o.InventoryLength())):
-        for field in INVFIELDS:
-            result[field].append(getattr(item, field)())
-    return result
-
-
-def _get_padded_inv(
-    response,
-    padded_length=DEFAULT_INV_PAD,
-    str_padded_length=DEFAULT_INVSTR_PAD,
-    alphabet_size=ord("~") - ord(" ") + 1,
-):
-    # TODO: This would be faster if done in C++.
-    inv = _get_inv(response)
-    strs = np.full(
-        (padded_length, str_padded_length), fill_value=alphabet_size, dtype=np.uint8
-    )
-    for i, b in enumerate(inv["Str"]):
-        strs[i, : len(b)] = np.frombuffer(b, dtype=np.uint8)[:str_padded_length] - 0x20
-
-    pad_width = (0, padded_length - len(inv["Str"]))
-    glyphs = np.pad(
-        np.asarray(inv["Glyph"], dtype=np.int16),
-        pad_width,
-        mode="constant",
-        constant_values=nethack.NO_GLYPH,
-    )
-    letters = np.pad(
-        np.asarray(inv["Letter"], dtype=np.uint8) - 0x20,
-        pad_width,
-        mode="constant",
-        constant_values=alphabet_size,
-    )
-    oclasses = np.pad(
-        np.asarray(inv["ObjectClass"], dtype=np.uint8),
-        pad_width,
-        mode="constant",
-        constant_values=nethack.MAXOCLASSES,
+# Parts of the Message's Observation each observation key is decoded from.
+MESSAGE_KEYS = {
+    "glyphs": ("glyphs",),
+    "glyphs_crop": ("glyphs_crop",),
+    "status": (),  # Blstats are always sent.
+    "message": (),  # So are the windows.
+    "inventory": ("inventory",),
+}
+
+# Fields of nle_obs each observation key is made of, with their shapes and
+# dtypes; helper.decode_into() fills them in from a Message. glyphs_crop is
+# added per NLE, it's as large as its crop.
+OBSERVATION_FIELDS = {
+    "glyphs": (("glyphs", DUNGEON_SHAPE, np.int16),),
+    "status": (("blstats", (23,), np.int32),),
+    "message": (("message", (DEFAULT_MSG_PAD,), np.uint8),),
+    "inventory": (
+        ("inv_glyphs", (DEFAULT_INV_PAD,), np.int16),
+        ("inv_strs", (DEFAULT_INV_PAD, DEFAULT_INVSTR_PAD), np.uint8),
+        ("inv_letters", (DEFAULT_INV_PAD,), np.uint8),
+        ("inv_oclasses", (DEFAULT_INV_PAD,), np.uint8),
+    ),
+}
+
+# Observations straight from nle_obs, for NLE(zero_copy=True): views of the
+# game's shared memory, with text NUL-padded as in include/nleobs.h.
+OBSERVATION_VIEWS = {
+    "glyphs": operator.itemgetter("glyphs"),
+    "status": operator.itemgetter("blstats"),
+    "message": operator.itemgetter("message"),
+    "inventory": operator.itemgetter(
+        "inv_glyphs", "inv_strs", "inv_letters", "inv_oclasses"
+    ),
+}
+
+
+def _shift_text(text, alphabet_size=ord("~") - ord(" ") + 1):
+    # From NUL-padded, as in nle_obs, to NLE's text observations: bytes -
+    # 0x20, padded with alphabet_size.
+    return np.where(text == 0, alphabet_size, text - 0x20).astype(np.uint8)
+
+
+def _copy_inventory(observation):
+    return (
+        observation["inv_glyphs"].copy(),
+        _shift_text(observation["inv_strs"]),
+        _shift_text(observation["inv_letters"]),
+        observation["inv_oclasses"].copy(),
     )
 
-    return glyphs, strs, letters, oclasses
+
+# Observations from nle_obs as arrays of their own, encoded as they are
+# from the Message; these are what NLE returns by default.
+OBSERVATION_COPIES = {
+    "glyphs": lambda observation: observation["glyphs"].copy(),
+    "status": lambda observation: observation["blstats"].copy(),
+    "message": lambda observation: _shift_text(observation["message"]),
+    "inventory": _copy_inventory,
+}
 
 
 class NLE(gym.Env):
@@ -250,6 +168,10 @@ class NLE(gym.Env):
 
     metadata = {"render.modes": ["human", "ansi"]}
 
+    # Parts of the Observation _is_episode_end() and _reward_fn() read from
+    # the Message, on top of those for observation_keys.
+    message_keys = ()
+
     class StepStatus(enum.IntEnum):
         """Specifies the status of the terminal state.
 
@@ -295,6 +217,10 @@ class NLE(gym.Env):
         observation_keys=("glyphs", "status", "message", "inventory"),
         actions=None,
         options=None,
+        glyphs_crop=(9, 9),
+        transport="shm",
+        zero_copy=False,
+        reuse=False,
     ):
         """Constructs a new NLE environment.
 
@@ -315,7 +241,24 @@ class NLE(gym.Env):
             options (list): list of game options to initialize NetHack. If None,
                 NetHack will be initialized with the options found in
                 ``nle.nethack.NETHACKOPTIONS`. Defaults to None.
+            glyphs_crop (tuple): (rows, cols) of the "glyphs_crop" observation,
+                the glyphs around the hero, with solid rock off the map; at
+                most 21 * 21 cells. Defaults to (9, 9).
+            transport (str): how observations get here from the nethack
+                process, see ``nethack.NetHack``. Defaults to "shm".
+            zero_copy (bool): if True, observations are views of the game's
+                shared memory rather than arrays of their own: no copies, but
+                they are overwritten ``NLE_SHM_SLOTS - 1`` steps later, and
+                text is NUL-padded bytes as in ``include/nleobs.h`` rather
+                than bytes - 0x20 padded with 95. Needs the "shm" transport.
+                Defaults to False.
+            reuse (bool): if True, each episode after the first is played
+                in the nethack process of the one before, rather than in a
+                new one; see ``nethack.NetHack``. Needs the "shm" transport.
+                Defaults to False.
         """
+        if zero_copy and transport != "shm":
+            raise ValueError("zero_copy needs the shm transport")
 
         self.character = character
         self._max_episode_steps = max_episode_steps
@@ -352,10 +295,21 @@ class NLE(gym.Env):
 
         self._setup_statsfile = archivefile is not None
 
+        message_keys = set(self.message_keys)
+        for key in observation_keys:
+            message_keys.update(MESSAGE_KEYS[key])
+        if transport != "shm":
+            # For render(); with shared memory, nle_obs always has them.
+            message_keys.update(("chars", "colors"))
+
         self.env = nethack.NetHack(
             archivefile=self.archivefile,
             options=options,
             playername="Agent%(pid)i-" + self.character,
+            transport=transport,
+            observation_keys=sorted(message_keys),
+            glyphs_crop=glyphs_crop,
+            reuse=reuse,
         )
 
         self._random = random.SystemRandom()
@@ -370,6 +324,12 @@ class NLE(gym.Env):
                 shape=DUNGEON_SHAPE,
                 dtype=np.int16,
             ),
+            "glyphs_crop": gym.spaces.Box(
+                low=np.iinfo(np.int16).min,
+                high=np.iinfo(np.int16).max,
+                shape=tuple(glyphs_crop),
+                dtype=np.int16,
+            ),
             "status": gym.spaces.Box(
                 low=np.iinfo(np.int32).min,
                 high=np.iinfo(np.int32).max,
@@ -416,20 +376,43 @@ class NLE(gym.Env):
             {key: space_dict[key] for key in observation_keys}
         )
 
-        self._key_functions = {
-            "glyphs": _get_glyphs,
-            "status": _get_status_fast,
-            "message": _get_padded_message,
-            "inventory": _get_padded_inv,
+        views = dict(
+            OBSERVATION_VIEWS if zero_copy else OBSERVATION_COPIES,
+            glyphs_crop=functools.partial(
+                _view_glyphs_crop, tuple(glyphs_crop), copy=not zero_copy
+            ),
+        )
+        self._view_functions = {
+            key: f for key, f in views.items() if key in observation_keys
+        }
+        fields = dict(
+            OBSERVATION_FIELDS,
+            glyphs_crop=(("glyphs_crop", tuple(glyphs_crop), np.int16),),
+        )
+        # Decoded into for each observation when there's no shared memory;
+        # the view functions copy out of it, as it's reused.
+        self._decoded = {
+            name: np.zeros(shape, dtype)
+            for key in observation_keys
+            for name, shape, dtype in fields[key]
         }
-        for key in list(self._key_functions.keys()):
-            if key not in observation_keys:
-                del self._key_functions[key]
 
         self.action_space = gym.spaces.Discrete(len(self._actions))
 
+    def _decode_observation(self, response):
+        if response is None:
+            for array in self._decoded.values():
+                array.fill(0)
+        else:
+            nethack.decode_into(response._tab.Bytes, self._decoded)
+        return self._decoded
+
     def _get_observation(self, response):
-        return {key: f(response) for key, f in self._key_functions.items()}
+        # From shared memory if there is any, as views with zero_copy.
+        observation = self.env.observation
+        if observation is None:
+            observation = self._decode_observation(response)
+        return {key: f(observation) for key, f in self._view_functions.items()}
 
     def step(self, action: int):
         """Steps the environment.
@@ -440,7 +423,9 @@ class NLE(gym.Env):
         Returns:
             (dict, float, bool, dict): a tuple containing
                 - (*dict*): an observation of the state; this will contain the keys
-                  specified by ``self.observation_space``.
+                  specified by ``self.observation_space``. With zero_copy, the
+                  arrays are views of the game's shared memory, which stay
+                  valid for ``NLE_SHM_SLOTS - 1`` more steps.
                 - (*float*): a reward; see ``self._reward_fn`` to see how it is
                   specified.
                 - (*bool*): True if the state is terminal, False otherwise.
@@ -599,14 +584,13 @@ class NLE(gym.Env):
 
         """
         if mode == "human":
-            nhprint.print_message(self.response)
+            nhprint.print_message(self.response, *self._get_map())
             return
         elif mode == "ansi":
             # TODO(NN): refactor print_message and output string here
-            chars = _get(self.response, "Observation.Chars")
-            if chars is None:
+            if self.response is None:
                 return ""
-            chars = _fb_ndarray_to_np(chars)
+            chars, _ = self._get_map()
             return "\n".join([line.tobytes().decode("utf-8") for line in chars])
         else:
             return super().render(mode=mode)
@@ -614,6 +598,18 @@ class NLE(gym.Env):
     def __repr__(self):
         return "<%s>" % self.__class__.__name__
 
+    def _get_map(self):
+        """Returns the chars and colors of the map, for render()."""
+        observation = self.env.observation
+        if observation is None:
+            observation = {
+                "chars": np.zeros(DUNGEON_SHAPE, dtype=np.uint8),
+                "colors": np.zeros(DUNGEON_SHAPE, dtype=np.uint8),
+            }
+            if self.response is not None:
+                nethack.decode_into(self.response._tab.Bytes, observation)
+        return observation["chars"], observation["colors"]
+
     def _is_episode_end(self, response):
         """Returns whether the episode has ended.
 
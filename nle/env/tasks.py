@@ -128,6 +128,8 @@ class NetHackStaircasePet(NetHackStaircase):
     having their pet next to it. See `NetHackStaircase` for the reward function.
     """
 
+    message_keys = ("glyphs",)
+
     def _is_episode_end(self, response) -> None:
         internal = response.Internal()
         if internal and internal.StairsDown():
@@ -157,6 +159,8 @@ class NetHackOracle(NetHackStaircase):
     See `NetHackStaircase` for the reward function.
     """
 
+    message_keys = ("glyphs",)
+
     def __init__(self, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.oracle_glyph = None
@@ -258,6 +262,8 @@ class NetHackScout(NetHackScore):
     defined by the changes in glyphs discovered by the agent.
     """
 
+    message_keys = ("glyphs",)
+
     def reset(self, *args, **kwargs):
         self.dungeon_explored = {}
         return super().reset(*args, **kwargs)
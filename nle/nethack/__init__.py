@@ -1,5 +1,15 @@
 # Copyright (c) Facebook, Inc. and its affiliates.
 from nle.nethack.actions import *  # noqa: F403
-from nle.nethack.nethack import NetHack, SEED_KEYS
+from nle.nethack.nethack import (
+    NetHack,
+    InProcessNetHack,
+    Checkpoint,
+    Branch,
+    VectorNetHack,
+    MapBuffer,
+    MAP_CELL_DTYPE,
+    OBSERVATION_KEYS,
+    SEED_KEYS,
+)
 
 from nle.nethack.helper import *  # noqa: F403
@@ -1,18 +1,51 @@
 # Copyright (c) Facebook, Inc. and its affiliates.
+import array
+import collections
 import functools
 import logging
+import mmap
 import os
+import select
 import shutil
+import signal
+import socket
 import tempfile
+import threading
 import time
 import warnings
 import weakref
 import zipfile
+import zlib
+
+import numpy as np
 
 from . import ptyprocess
+from .actions import MiscAction
 import zmq
 
 
+class _MissingModule:
+    """Stands in for an extension module that couldn't be imported."""
+
+    def __init__(self, name, error):
+        self._name = name
+        self._error = error
+
+    def __getattr__(self, attr):
+        raise ImportError(
+            "%s is needed for this, but couldn't be imported: %s"
+            % (self._name, self._error)
+        )
+
+
+try:
+    from . import _pynethack
+except ImportError as e:
+    # Only InProcessNetHack, VectorNetHack and the shm transport need it,
+    # not NetHack over the pty and ZMQ.
+    _pynethack = _MissingModule("nle.nethack._pynethack", e)
+
+
 with warnings.catch_warnings():
     warnings.filterwarnings("ignore", category=DeprecationWarning)
     # Import all flatbuffer modules.
@@ -36,6 +69,29 @@ with warnings.catch_warnings():
 
 SEED_KEYS = ["core", "disp"]
 
+# Optional parts of the Observation in each Message. See NLE_OBSERVATION_KEYS
+# in win/rl/winrl.cc.
+OBSERVATION_KEYS = (
+    "glyphs",
+    "chars",
+    "colors",
+    "specials",
+    "status",
+    "inventory",
+    "map_delta",
+    "glyphs_crop",
+)
+
+# Layout of the MapCell struct in win/rl/message.fbs.
+MAP_CELL_DTYPE = np.dtype(
+    {
+        "names": ["index", "glyph", "ch", "color", "special"],
+        "formats": [np.uint16, np.int16, np.uint8, np.uint8, np.uint8],
+        "offsets": [0, 2, 4, 5, 6],
+        "itemsize": 8,
+    }
+)
+
 NETHACKOPTIONS = [
     "windowtype:rl",
     "color",
@@ -68,8 +124,36 @@ if not os.path.exists(EXECUTABLE):
         "Couldn't run nethack in %s as file doesn't exist" % EXECUTABLE
     )
 
+DLPATH = os.path.join(HACKDIR, "libnethack.so")
+
+# Where files only nethack and we need go when there is no HACKDIR of our
+# own, see _make_vardir(); None for the default tempdir.
+_SHMDIR = "/dev/shm" if os.path.isdir("/dev/shm") else None
+
 
-def _exec_nethack(playername, hackdir, seeds=None, options=NETHACKOPTIONS):
+def _memfd(name):
+    """Returns the fd of a new file in memory, never written back to disk."""
+    if hasattr(os, "memfd_create"):
+        return os.memfd_create(name, os.MFD_CLOEXEC)
+    fd, filename = tempfile.mkstemp(prefix=name + ".", dir=_SHMDIR)
+    os.unlink(filename)
+    return fd
+
+
+def _exec_nethack(
+    playername,
+    hackdir,
+    seeds=None,
+    options=NETHACKOPTIONS,
+    observation_keys=None,
+    headless=False,
+    shm=None,
+    zygote=None,
+    restore=None,
+    diskless=False,
+    glyphs_crop=None,
+    reuse=None,
+):
     """Turns current process into NetHack with right environment variables."""
     user = playername % {"pid": os.getpid()}
 
@@ -86,6 +170,38 @@ def _exec_nethack(playername, hackdir, seeds=None, options=NETHACKOPTIONS):
             name = "NLE_SEED_" + name.upper()
             env[name] = str(seed)
 
+    if observation_keys is not None:
+        env["NLE_OBSERVATION_KEYS"] = ",".join(observation_keys)
+
+    if glyphs_crop is not None:
+        env["NLE_GLYPHS_CROP"] = ",".join(str(n) for n in glyphs_crop)
+
+    if headless:
+        env["NLE_HEADLESS"] = "1"
+
+    if shm is not None:
+        shm_fd, notify_fd, action_fd, control_fd = shm
+        for fd in shm:
+            os.set_inheritable(fd, True)
+        env["NLE_SHM"] = str(shm_fd)
+        env["NLE_SHM_NOTIFY"] = str(notify_fd)
+        env["NLE_SHM_ACTION"] = str(action_fd)
+        env["NLE_CONTROL"] = str(control_fd)
+
+    if zygote is not None:
+        os.set_inheritable(zygote, True)
+        env["NLE_ZYGOTE"] = str(zygote)
+
+    if reuse is not None:
+        os.set_inheritable(reuse, True)
+        env["NLE_REUSE"] = str(reuse)
+
+    if restore is not None:
+        env["NLE_RESTORE"] = restore
+
+    if diskless:
+        env["NLE_DISKLESS"] = "1"
+
     command = EXECUTABLE + " -u" + user
 
     shell = os.environ.get("SHELL", "/bin/bash")
@@ -110,6 +226,665 @@ def _recordclosefn(archive, filename):
     os.unlink(filename)
 
 
+def _make_vardir(diskless=False):
+    """Creates a HACKDIR for one NetHack object, sharing nhdat.
+
+    Diskless games write no files and so get none: they run in the installed
+    HACKDIR, and None is returned.
+    """
+    if diskless:
+        return None
+    vardir = tempfile.mkdtemp(prefix="nle")
+
+    os.symlink(os.path.join(HACKDIR, "nhdat"), os.path.join(vardir, "nhdat"))
+
+    # touch a few files.
+    for filename in ["sysconf", "perm", "logfile", "xlogfile"]:
+        os.close(os.open(os.path.join(vardir, filename), os.O_CREAT))
+    os.mkdir(os.path.join(vardir, "save"))
+    return vardir
+
+
+def _remove_vardir(vardir, ignore_errors=False):
+    if vardir is not None:
+        shutil.rmtree(vardir, ignore_errors)
+
+
+def _open_archive(archivefile):
+    """Returns (archive, recordclosefn, finalizer) for the archivefile."""
+    if archivefile is None:
+        return None, lambda f: None, None
+
+    try:
+        archive = zipfile.ZipFile(
+            archivefile % {"pid": os.getpid(), "time": time.strftime("%Y%m%d-%H%M%S")},
+            "x",
+        )
+    except FileExistsError:
+        logging.exception("Archive file %s exists, terminating" % archivefile)
+        raise
+
+    recordclosefn = functools.partial(_recordclosefn, archive)
+    logging.info("Archiving replays in %s" % archive.filename)
+    # Cannot close archive before final call to _recordclosefn.
+    # Binding to lifetime of self doesn't work here, so bind to
+    # _recordclosefn itself.
+    return archive, recordclosefn, weakref.finalize(recordclosefn, archive.close)
+
+
+def _check_seeds(seeds):
+    if isinstance(seeds, dict):
+        for k in SEED_KEYS:
+            if k not in seeds:
+                continue
+            if seeds[k] < 1:
+                raise ValueError(
+                    "Found %d for %s, but seeds must be positive integers.",
+                    seeds[k],
+                    k,
+                )
+    elif seeds is not None:
+        raise ValueError("`seeds` is %s, but must be either None or a dict.", seeds)
+
+
+def _shm_views(buf, offset):
+    """Numpy views of the nle_obs at offset in buf, see include/nleobs.h."""
+    offsets = _pynethack.NLE_OBS_OFFSETS
+    shape = (_pynethack.NLE_MAP_ROWS, _pynethack.NLE_MAP_COLS)
+
+    def view(key, dtype, shape):
+        count = int(np.prod(shape))
+        return np.frombuffer(buf, dtype, count, offset + offsets[key]).reshape(shape)
+
+    inventory = (_pynethack.NLE_INVENTORY_SIZE,)
+    inventory_strs = inventory + (_pynethack.NLE_INVENTORY_STR_LENGTH,)
+
+    return {
+        "glyphs": view("glyphs", np.int16, shape),
+        "chars": view("chars", np.uint8, shape),
+        "colors": view("colors", np.uint8, shape),
+        "specials": view("specials", np.uint8, shape),
+        "glyphs_crop": view("glyphs_crop", np.int16, (_pynethack.NLE_CROP_SIZE,)),
+        "blstats": view("blstats", np.int32, (_pynethack.NLE_BLSTATS_SIZE,)),
+        "message": view("message", np.uint8, (_pynethack.NLE_MESSAGE_SIZE,)),
+        "inv_glyphs": view("inv_glyphs", np.int16, inventory),
+        "inv_strs": view("inv_strs", np.uint8, inventory_strs),
+        "inv_letters": view("inv_letters", np.uint8, inventory),
+        "inv_oclasses": view("inv_oclasses", np.uint8, inventory),
+    }
+
+
+class MapBuffer:
+    """Map arrays kept up to date from the map_delta part of Messages.
+
+    Needs a NetHack with "map_delta" in its observation_keys. Arrays are
+    valid once the first keyframe arrived, see synced.
+    """
+
+    def __init__(self):
+        shape = (_pynethack.NLE_MAP_ROWS, _pynethack.NLE_MAP_COLS)
+        self.glyphs = np.zeros(shape, dtype=np.int16)
+        self.chars = np.zeros(shape, dtype=np.uint8)
+        self.colors = np.zeros(shape, dtype=np.uint8)
+        self.specials = np.zeros(shape, dtype=np.uint8)
+        self.synced = False
+
+    def update(self, message):
+        """Applies the map_delta of message, if any. Returns self.synced."""
+        observation = message.Observation()
+        delta = observation.MapDelta() if observation is not None else None
+        if delta is None:
+            return self.synced
+        if delta.Keyframe():
+            self.synced = True
+
+        # Straight from the buffer, Cells(i) would be one object per cell.
+        tab = delta._tab
+        o = tab.Offset(6)  # cells
+        if o == 0:
+            return self.synced
+        cells = np.frombuffer(
+            tab.Bytes, MAP_CELL_DTYPE, tab.VectorLen(o), tab.Vector(o)
+        )
+        index = cells["index"]
+        self.glyphs.reshape(-1)[index] = cells["glyph"]
+        self.chars.reshape(-1)[index] = cells["ch"]
+        self.colors.reshape(-1)[index] = cells["color"]
+        self.specials.reshape(-1)[index] = cells["special"]
+        return self.synced
+
+
+class _ShmChannel:
+    """Receiving end of the shared-memory transport, see include/nleshm.h.
+
+    The nethack process writes each observation into the next slot of a ring
+    in memory we both map and wakes us up with a byte on a pipe. Messages and
+    observation arrays are views of the ring, not copies: they stay valid for
+    NLE_SHM_SLOTS - 1 more steps. Actions go the other way on a second pipe,
+    bypassing the pty. A datagram socket takes requests for copies of the
+    game, see branch(), and for snapshots of it, see save().
+    """
+
+    def __init__(self, directory):
+        # No directory of its own: the game is diskless, see _make_vardir().
+        self.diskless = directory is None
+        self.shm_fd = _memfd("nle.shm")
+        os.ftruncate(self.shm_fd, _pynethack.NLE_SHM_SIZE)
+        self._shm = mmap.mmap(self.shm_fd, _pynethack.NLE_SHM_SIZE)
+        self._notify_r, self.notify_w = os.pipe()
+        self.action_r, self._action_w = os.pipe()
+        self._control, control = socket.socketpair(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.control_s = control.detach()
+
+        self._seq = np.frombuffer(
+            self._shm, np.uint64, 1, _pynethack.NLE_SHM_SEQ_OFFSET
+        )
+        self._slots = []
+        for i in range(_pynethack.NLE_SHM_SLOTS):
+            offset = _pynethack.NLE_SHM_SLOT_OFFSET + i * _pynethack.NLE_SHM_SLOT_SIZE
+            message_size = np.frombuffer(
+                self._shm,
+                np.uint32,
+                1,
+                offset + _pynethack.NLE_SHM_MESSAGE_SIZE_OFFSET,
+            )
+            self._slots.append(
+                (
+                    offset + _pynethack.NLE_SHM_MESSAGE_OFFSET,
+                    message_size,
+                    _shm_views(self._shm, offset),
+                )
+            )
+        self.observation = None
+
+    @property
+    def fds(self):
+        """nethack's: NLE_SHM, NLE_SHM_NOTIFY, NLE_SHM_ACTION, NLE_CONTROL."""
+        return self.shm_fd, self.notify_w, self.action_r, self.control_s
+
+    def forked(self):
+        """Drops our copies of nethack's fds once it has its own."""
+        os.close(self.shm_fd)
+        self.shm_fd = None
+        os.close(self.notify_w)
+        self.notify_w = None
+        os.close(self.action_r)
+        self.action_r = None
+        os.close(self.control_s)
+        self.control_s = None
+
+    def branch(self, env, shm):
+        """Forks the game, which must be waiting for a key, with env set.
+
+        The copy is attached to the _ShmChannel shm and first sends the
+        observation the game is waiting on. Returns the copy's pid.
+        """
+        return _request_game(self._control, env, shm)
+
+    def save(self):
+        """Returns the game, which must be waiting for a key, as a save file.
+
+        See nle_control() in unixmain.c. The game goes on unaffected.
+        """
+        self._control.sendmsg([b"save"])
+        reply, ancdata, _, _ = self._control.recvmsg(32, socket.CMSG_SPACE(4))
+        if not reply:
+            raise IOError("NetHack process exited")
+        size = int(reply)
+        if size < 0:
+            raise IOError("NetHack process couldn't save the game")
+        fds = array.array("i")
+        fds.frombytes(ancdata[0][2][: fds.itemsize])
+        try:
+            return os.pread(fds[0], size, 0)
+        finally:
+            os.close(fds[0])
+
+    def send(self, action):
+        os.write(self._action_w, bytes((action,)))
+
+    def poll(self, timeout):
+        return bool(select.select([self._notify_r], [], [], timeout)[0])
+
+    def recv(self):
+        if not os.read(self._notify_r, 1):
+            raise IOError("NetHack process exited without a message")
+        seq = int(self._seq[0])
+        offset, size, self.observation = self._slots[(seq - 1) % len(self._slots)]
+        return memoryview(self._shm)[offset : offset + int(size[0])]
+
+    def close(self):
+        # The mapping itself goes away with the last message viewing it.
+        os.close(self._notify_r)
+        os.close(self._action_w)
+        self._control.close()
+        for fd in (self.shm_fd, self.notify_w, self.action_r, self.control_s):
+            if fd is not None:
+                os.close(fd)
+
+
+def _game_env(vardir, seeds):
+    """The environment of a game forked off with _request_game()."""
+    env = {"HACKDIR": vardir or HACKDIR}
+    for name, seed in (seeds or {}).items():
+        env["NLE_SEED_" + name.upper()] = str(seed)
+    return env
+
+
+def _request_game(sock, env, shm):
+    """Asks for a new game on sock, see nle_recv_request() in unixmain.c."""
+    request = "".join("%s=%s\n" % item for item in env.items()).encode()
+    fds = array.array("i", shm.fds)
+    sock.sendmsg([request], [(socket.SOL_SOCKET, socket.SCM_RIGHTS, fds.tobytes())])
+    reply = sock.recv(32)
+    if not reply:
+        raise IOError("NetHack process exited")
+    pid = int(reply)
+    if pid < 0:
+        raise IOError("NetHack process couldn't fork")
+    return pid
+
+
+def _wait_gone(pid, timeout):
+    """Whether pid is gone within timeout seconds."""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            os.kill(pid, 0)
+        except ProcessLookupError:
+            return True
+        time.sleep(0.001)
+    return False
+
+
+def _kill_game(pid):
+    # Not our child, so no waitpid(); the zygote reaps it. Should nobody,
+    # it stays a zombie: give up rather than hang in a finalizer.
+    try:
+        os.kill(pid, signal.SIGTERM)
+        if _wait_gone(pid, 1.0):
+            return
+        os.kill(pid, signal.SIGKILL)
+    except ProcessLookupError:
+        return
+    if not _wait_gone(pid, 1.0):
+        logging.warning("nethack game %i didn't exit after SIGKILL", pid)
+
+
+class _ZygoteGame:
+    """A game forked off by a _Zygote. Stands in for its PtyProcess."""
+
+    def __init__(self, zygote, pid):
+        self.pid = pid
+        self.filename = zygote.process.filename
+        self._zygote = zygote
+        self._finalizer = weakref.finalize(self, _kill_game, pid)
+
+    def write_record_frame(self, buf, channel):
+        self._zygote.process.write_record_frame(buf, channel)
+
+    def term(self):
+        self._finalizer()
+
+
+class _Zygote:
+    """A nethack process that forks off a new game per reset.
+
+    It gets as far into main() as games don't differ (options, window port,
+    nhdat), then waits for requests on a datagram socket, see nle_zygote()
+    in sys/unix/unixmain.c. Games share the zygote's pty, so its ttyrec
+    records all of them.
+    """
+
+    def __init__(self, exec_nethack, rows, columns, headless, recordname, closefn):
+        self._socket, theirs = socket.socketpair(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.process = ptyprocess.PtyProcess(
+            target=functools.partial(exec_nethack, zygote=theirs.fileno()),
+            recordclosefn=closefn,
+            recordname=recordname,
+        )
+        try:
+            self.process.fork(rows=rows, columns=columns, wait_for_output=not headless)
+        finally:
+            theirs.close()
+
+    def spawn(self, env, shm):
+        """Starts a game with env set, attached to the _ShmChannel shm."""
+        return _ZygoteGame(self, _request_game(self._socket, env, shm))
+
+
+class _ReusedGame:
+    """A game played by a _Reuser's process. Stands in for its PtyProcess."""
+
+    def __init__(self, process):
+        self.pid = process.pid
+        self.filename = process.filename
+        self._process = process
+
+    def write_record_frame(self, buf, channel):
+        self._process.write_record_frame(buf, channel)
+
+
+class _Reuser:
+    """A nethack process that plays one game after another.
+
+    It takes requests for new games on a datagram socket like a _Zygote, but
+    plays them itself: once a game is over, it resets its globals and starts
+    over in main(), see nle_reuse() in sys/unix/unixmain.c. A game left
+    before it is over hangs up when its _ShmChannel is closed, which ends
+    the process; so does a game that ends badly. The next game then gets a
+    new process. Games share the process's pty, so its ttyrec records all
+    of them.
+    """
+
+    def __init__(self, exec_nethack, rows, columns, recordname, closefn):
+        self._args = (exec_nethack, rows, columns, recordname, closefn)
+        self.process = None
+
+    def _fork(self):
+        exec_nethack, rows, columns, recordname, closefn = self._args
+        self._socket, theirs = socket.socketpair(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.process = ptyprocess.PtyProcess(
+            target=functools.partial(exec_nethack, reuse=theirs.fileno()),
+            recordclosefn=closefn,
+            recordname=recordname,
+        )
+        try:
+            # Nothing to wait for: no output before the first request.
+            self.process.fork(rows=rows, columns=columns)
+        finally:
+            theirs.close()
+
+    def spawn(self, env, shm):
+        """Starts a game with env set, attached to the _ShmChannel shm."""
+        if self.process is not None:
+            try:
+                _request_game(self._socket, env, shm)
+                return _ReusedGame(self.process)
+            except OSError:
+                # The last game took the process with it.
+                self._socket.close()
+                self.process = None  # Reaped once its games are gone.
+        self._fork()
+        _request_game(self._socket, env, shm)
+        return _ReusedGame(self.process)
+
+
+class _ShmGames:
+    """Starts games on the "shm" transport: directly, off a _Zygote or in a _Reuser."""
+
+    def __init__(
+        self,
+        playername,
+        options,
+        observation_keys,
+        headless,
+        rows,
+        columns,
+        recordclosefn,
+        zygote_vardir=None,
+        diskless=False,
+        glyphs_crop=None,
+        reuse=False,
+    ):
+        self._exec_args = (playername, options, observation_keys, headless)
+        self.diskless = diskless
+        self._glyphs_crop = glyphs_crop
+        self._rows = rows
+        self._columns = columns
+        self._headless = headless
+        self._recordclosefn = recordclosefn
+        self._zygote_vardir = zygote_vardir
+        self._spawner = None
+        self._reuse = reuse
+
+    def _exec_nethack(self, vardir, seeds, **kwargs):
+        playername, options, observation_keys, headless = self._exec_args
+        return functools.partial(
+            _exec_nethack,
+            playername,
+            vardir or HACKDIR,
+            seeds,
+            options,
+            observation_keys,
+            headless,
+            diskless=self.diskless,
+            glyphs_crop=self._glyphs_crop,
+            **kwargs
+        )
+
+    def _get_spawner(self, recordname):
+        """The _Zygote or _Reuser that starts games, None to exec nethack."""
+        if self._spawner is None and self._reuse:
+            self._spawner = _Reuser(
+                self._exec_nethack(None, None),
+                self._rows,
+                self._columns,
+                "nethack.reuse.%(time)s.%(pid)i.ttyrec" if recordname else None,
+                self._recordclosefn,
+            )
+        elif self._spawner is None and self._zygote_vardir is not None:
+            self._spawner = _Zygote(
+                self._exec_nethack(self._zygote_vardir, None),
+                self._rows,
+                self._columns,
+                self._headless,
+                "nethack.zygote.%(time)s.%(pid)i.ttyrec" if recordname else None,
+                self._recordclosefn,
+            )
+        return self._spawner
+
+    def start(self, vardir, seeds, recordname, state=None):
+        """Returns (process, shm, message) of a new game in vardir.
+
+        vardir is None for diskless games. With state, a save file from
+        _ShmChannel.save(), the game is restored from it rather than started
+        anew.
+        """
+        shm = _ShmChannel(vardir)
+        restore = None
+        if state is not None:
+            fd, restore = tempfile.mkstemp(
+                suffix=".nle.save", dir=vardir or _SHMDIR
+            )
+            with os.fdopen(fd, "wb") as f:
+                f.write(state)
+        spawner = self._get_spawner(recordname)
+        if spawner is not None:
+            env = _game_env(vardir, seeds)
+            if restore is not None:
+                env["NLE_RESTORE"] = restore
+            process = spawner.spawn(env, shm)
+        else:
+            process = ptyprocess.PtyProcess(
+                target=self._exec_nethack(
+                    vardir, seeds, shm=shm.fds, restore=restore
+                ),
+                recordclosefn=self._recordclosefn,
+                recordname=recordname,
+            )
+            process.fork(
+                rows=self._rows,
+                columns=self._columns,
+                wait_for_output=not self._headless,
+            )
+        shm.forked()
+
+        weakref.finalize(process, shm.close)
+        if vardir is not None:
+            weakref.finalize(process, _finalize_one_run, vardir)
+
+        if not shm.poll(timeout=1.0):
+            raise IOError("No response received from NetHack process -- is it running?")
+
+        message = Message.Message.GetRootAsMessage(shm.recv(), 0)
+        assert not message.NotRunning(), "NetHack closed without input."
+
+        if restore is not None:
+            os.unlink(restore)
+
+        return process, shm, message
+
+
+class _WarmPool:
+    """Games started ahead of time and stepped into their moveloop.
+
+    A thread keeps size games ready, each in its own HACKDIR, so get()
+    only waits if games get used up faster than they start. Games are
+    started with the seeds last passed to seed(); changing them drops the
+    games started with the old ones.
+    """
+
+    def __init__(self, size, games, archive):
+        self._size = size
+        self._games = games
+        self._recordname = "nethack.pool.%(time)s.%(pid)i.ttyrec" if archive else None
+        self._seeds = None
+        self._ready = collections.deque()
+        self._error = None
+        self._closed = False
+        self._cond = threading.Condition()
+        self._thread = threading.Thread(target=self._fill, daemon=True)
+        self._thread.start()
+
+    def seed(self, seeds):
+        with self._cond:
+            if seeds != self._seeds:
+                self._seeds = seeds
+                self._ready.clear()
+                self._cond.notify_all()
+
+    def get(self):
+        """Returns (process, shm, message) of a game in its moveloop."""
+        with self._cond:
+            self._cond.wait_for(lambda: self._ready or self._error is not None)
+            if self._error is not None:
+                raise self._error
+            game = self._ready.popleft()
+            self._cond.notify_all()
+        return game
+
+    def close(self):
+        with self._cond:
+            self._closed = True
+            self._ready.clear()
+            self._cond.notify_all()
+        self._thread.join()
+
+    def _fill(self):
+        try:
+            while True:
+                with self._cond:
+                    self._cond.wait_for(
+                        lambda: self._closed or len(self._ready) < self._size
+                    )
+                    if self._closed:
+                        return
+                    seeds = self._seeds
+                game = self._start(seeds)
+                with self._cond:
+                    if seeds == self._seeds and not self._closed:
+                        self._ready.append(game)
+                        self._cond.notify_all()
+        except Exception as e:
+            with self._cond:
+                self._error = e
+                self._cond.notify_all()
+
+    def _start(self, seeds):
+        vardir = _make_vardir(self._games.diskless)
+        try:
+            process, shm, message = self._games.start(vardir, seeds, self._recordname)
+        except Exception:
+            _remove_vardir(vardir)
+            raise
+        weakref.finalize(process, _remove_vardir, vardir, True)
+
+        while not message.ProgramState().InMoveloop():
+            if process.filename is not None:
+                process.write_record_frame(bytes((MiscAction.MORE,)), 1)
+            shm.send(MiscAction.MORE)
+            message = Message.Message.GetRootAsMessage(shm.recv(), 0)
+            if message.NotRunning():
+                raise IOError("NetHack closed before its moveloop.")
+        return process, shm, message
+
+
+def _end_copy(pid, shm, vardir):
+    _kill_game(pid)
+    shm.close()
+    _remove_vardir(vardir, True)
+
+
+class _GameCopy:
+    """A copy of a game, forked off by the game's _ShmChannel.branch().
+
+    Copies play in a HACKDIR of their own, unless diskless, and are nobody's
+    child: they live on until closed, whatever happens to the game they were
+    copied from.
+    """
+
+    def __init__(self, source, seeds):
+        vardir = _make_vardir(source.diskless)
+        shm = _ShmChannel(vardir)
+        try:
+            self.pid = source.branch(_game_env(vardir, seeds), shm)
+        except Exception:
+            shm.close()
+            _remove_vardir(vardir)
+            raise
+        shm.forked()
+        self._shm = shm
+        self._info = {"pid": self.pid}
+        self._finalizer = weakref.finalize(self, _end_copy, self.pid, shm, vardir)
+
+        if not shm.poll(timeout=1.0):
+            raise IOError("No response received from NetHack copy")
+        self.message = Message.Message.GetRootAsMessage(shm.recv(), 0)
+
+    @property
+    def observation(self):
+        """Arrays of the last observation, as in NetHack.observation."""
+        return self._shm.observation
+
+    def save_to_buffer(self):
+        """The game as it is now, as in NetHack.save_to_buffer()."""
+        return zlib.compress(self._shm.save(), 1)
+
+    def close(self):
+        self._finalizer()
+
+
+class Checkpoint(_GameCopy):
+    """A game paused where it was checkpointed, see NetHack.checkpoint().
+
+    It only ever gets branched off, never stepped, so it stays as it was;
+    message is the Message the game was waiting on.
+    """
+
+
+class Branch(_GameCopy):
+    """A game of its own that starts off where a Checkpoint was taken.
+
+    Stepped like a NetHack, independently of the checkpoint, other branches
+    and the original game. With seeds, its RNGs are reseeded; without, it
+    continues with the checkpoint's, so equal actions give equal games.
+    """
+
+    def __init__(self, checkpoint, seeds=None):
+        _check_seeds(seeds)
+        super().__init__(checkpoint._shm, seeds)
+
+    def step(self, action):
+        self._shm.send(action)
+        message = Message.Message.GetRootAsMessage(self._shm.recv(), 0)
+        return message, message.NotRunning(), self._info
+
+    def checkpoint(self):
+        """Returns a Checkpoint of this branch as it is now."""
+        return Checkpoint(self._shm, None)
+
+
 class NetHack:
     def __init__(
         self,
@@ -119,8 +894,93 @@ class NetHack:
         rows=24,
         columns=80,
         context=None,
+        transport=None,
+        observation_keys=None,
+        headless=False,
+        zygote=False,
+        pool_size=0,
+        diskless=False,
+        glyphs_crop=None,
+        reuse=False,
     ):
-        """Constructs a new NetHack environment."""
+        """Constructs a new NetHack environment.
+
+        transport is how observations get here from the nethack process:
+        "zmq" for a ZMQ socket (in context), or "shm" for shared memory.
+        With "shm", actions also skip the pty and go to nethack on a pipe,
+        and observation holds views of the game's memory. None is "zmq",
+        unless zygote, pool_size, diskless or reuse ask for "shm".
+
+        observation_keys are the parts of the Observation (see
+        OBSERVATION_KEYS) the nethack process puts into each Message; None
+        for all of them. Unlisted parts are left out of the flatbuffer, the
+        arrays in the observation property are always complete.
+
+        headless runs nethack without its tty window port: nothing gets
+        drawn on the terminal, so the ttyrecs in archivefile stay empty.
+        Menus, prompts and --More-- take the same keys as with the tty.
+
+        zygote keeps one nethack process around that has done the setup
+        common to all games and forks it for each reset, instead of starting
+        nethack anew. Needs the "shm" transport. The ttyrec in archivefile
+        then covers all episodes.
+
+        pool_size games are kept ready in the background, already stepped
+        into their moveloop, so that reset() needn't wait for nethack to
+        start. Needs the "shm" transport. Seeds passed to seed() apply to
+        games started after the call; the ones ready already are dropped.
+
+        diskless games read nhdat and sysconf from the installed HACKDIR
+        and write no files: no lock or level files, no bones, no record,
+        logfile or xlogfile. The Message of a game that ended has its
+        xlogfile entry instead. Needs the "shm" transport; archivefile
+        still gets written unless None.
+
+        glyphs_crop is (rows, cols) or (rows, cols, fill) of the
+        "glyphs_crop" observation, the glyphs around the hero with fill
+        (solid rock by default) off the map; None for 9 by 9. It has at
+        most NLE_CROP_SIZE cells.
+
+        reuse plays the next game in the nethack process of the last one,
+        if that game is over: the process resets its globals and starts
+        over, instead of nethack being started anew. A game reset before it
+        is over still ends its process. Needs the "shm" transport, and
+        can't be combined with zygote or pool_size. The ttyrec in
+        archivefile then covers all episodes of a process. Off by default,
+        as the reset copies back nethack's whole writable data segment,
+        libc's objects in it included, see nle_reuse() in unixmain.c.
+        """
+        if transport is None:
+            transport = "shm" if zygote or pool_size or diskless or reuse else "zmq"
+        if transport not in ("shm", "zmq"):
+            raise ValueError("Unknown transport %s" % transport)
+        if zygote and transport != "shm":
+            raise ValueError("zygote needs the shm transport")
+        if pool_size and transport != "shm":
+            raise ValueError("pool_size needs the shm transport")
+        if diskless and transport != "shm":
+            raise ValueError("diskless needs the shm transport")
+        if reuse and transport != "shm":
+            raise ValueError("reuse needs the shm transport")
+        if reuse and (zygote or pool_size):
+            raise ValueError("reuse can't be combined with zygote or pool_size")
+        if glyphs_crop is not None:
+            rows, cols = glyphs_crop[:2]
+            # Without _pynethack, nethack itself turns down crops too large.
+            too_large = not isinstance(_pynethack, _MissingModule) and (
+                rows * cols > _pynethack.NLE_CROP_SIZE
+            )
+            if rows <= 0 or cols <= 0 or too_large:
+                raise ValueError("Bad glyphs_crop %s" % (glyphs_crop,))
+        if observation_keys is not None:
+            observation_keys = tuple(observation_keys)
+            for key in observation_keys:
+                if key not in OBSERVATION_KEYS:
+                    raise ValueError("Unknown observation key %s" % key)
+        self._transport = transport
+        self._observation_keys = observation_keys
+        self._glyphs_crop = glyphs_crop
+        self._headless = headless
         self._playername = playername
         self._rows = rows
         self._columns = columns
@@ -140,67 +1000,72 @@ class NetHack:
             raise FileNotFoundError("Couldn't find NetHack installation.")
 
         # Create a HACKDIR for us.
-        self._vardir = tempfile.mkdtemp(prefix="nle")
+        self._vardir = _make_vardir(diskless)
 
-        os.symlink(os.path.join(HACKDIR, "nhdat"), os.path.join(self._vardir, "nhdat"))
+        self._archive, self._recordclosefn, finalizer = _open_archive(archivefile)
+        if finalizer is not None:
+            self._finalizers.append(finalizer)
 
-        # touch a few files.
-        for filename in ["sysconf", "perm", "logfile", "xlogfile"]:
-            os.close(os.open(os.path.join(self._vardir, filename), os.O_CREAT))
-        os.mkdir(os.path.join(self._vardir, "save"))
-
-        if archivefile is None:
-            self._archive = None
-            self._recordclosefn = lambda f: None
+        if transport == "zmq":
+            self._context = context or zmq.Context.instance()
+            self._games = None
         else:
-            try:
-                self._archive = zipfile.ZipFile(
-                    archivefile
-                    % {"pid": os.getpid(), "time": time.strftime("%Y%m%d-%H%M%S")},
-                    "x",
-                )
-            except FileExistsError:
-                logging.exception("Archive file %s exists, terminating" % archivefile)
-                raise
-
-            self._recordclosefn = functools.partial(_recordclosefn, self._archive)
-            self._finalizers.append(
-                # Cannot close archive before final call to _recordclosefn.
-                # Binding to lifetime of self doesn't work here, so bind to
-                # _recordclosefn itself.
-                weakref.finalize(self._recordclosefn, self._archive.close)
+            self._games = _ShmGames(
+                playername,
+                options,
+                observation_keys,
+                headless,
+                rows,
+                columns,
+                self._recordclosefn,
+                (self._vardir or HACKDIR) if zygote else None,
+                diskless,
+                glyphs_crop,
+                reuse,
             )
-            logging.info("Archiving replays in %s" % self._archive.filename)
-
-        self._context = context or zmq.Context.instance()
+        self._shm = None
 
-        self._finalizers.append(weakref.finalize(self, shutil.rmtree, self._vardir))
+        self._finalizers.append(weakref.finalize(self, _remove_vardir, self._vardir))
 
+        self._pool = None
         self._exec_nethack = None
         self.seed(None)  # Sets self._exec_nethack.
 
-        # TODO(heiner): Consider having a collections.deque of processes for
-        # pre-loading. This requires us to have different connections, which
-        # would be great to support more than one NetHack object.
+        if pool_size:
+            self._pool = _WarmPool(pool_size, self._games, self._archive is not None)
+            self._finalizers.append(weakref.finalize(self, self._pool.close))
         self._process = None
 
     def _recv(self):
-        buf = self._socket.recv()
+        if self._shm is not None:
+            buf = self._shm.recv()
+        else:
+            buf = self._socket.recv()
         message = Message.Message.GetRootAsMessage(buf, 0)
         # TODO(heiner): Consider waitpid'ing to get process status.
         return message, message.NotRunning()
 
-    def reset(self):
+    def _set_recordname(self):
         if self._archive is None:
             self.recordname = None
         else:
             self.recordname = "nethack.run.%i.%%(time)s.%%(pid)i.ttyrec" % self._episode
+
+    def reset(self):
+        self._set_recordname()
+        if self._transport == "shm":
+            return self._reset_shm()
+
         self._process = ptyprocess.PtyProcess(
             target=self._exec_nethack,
             recordclosefn=self._recordclosefn,
             recordname=self.recordname,
         )
-        self._process.fork(rows=self._rows, columns=self._columns, wait_for_output=True)
+        self._process.fork(
+            rows=self._rows,
+            columns=self._columns,
+            wait_for_output=not self._headless,
+        )
 
         socketfile = os.path.join(self._vardir, "%i.nle.sock" % self._process.pid)
         address = "ipc://" + socketfile
@@ -220,6 +1085,21 @@ class NetHack:
         # Connection established, can remove socket file from file system.
         os.unlink(socketfile)
 
+        return self._started(message)
+
+    def _reset_shm(self):
+        # Ends the previous game first: games in one HACKDIR can share a
+        # name, and so a lock file.
+        self._process = None
+        if self._pool is not None:
+            self._process, self._shm, message = self._pool.get()
+        else:
+            self._process, self._shm, message = self._games.start(
+                self._vardir, self._seeds, self.recordname
+            )
+        return self._started(message)
+
+    def _started(self, message):
         self._info["pid"] = self._process.pid
         self._info["episode"] = self._episode
 
@@ -227,32 +1107,82 @@ class NetHack:
 
         return message
 
+    @property
+    def observation(self):
+        """Arrays of the last observation, as views into shared memory.
+
+        Only available with the "shm" transport, None otherwise. Keys are
+        the fields of nle_obs, see include/nleobs.h; glyphs_crop is flat,
+        its first rows * cols glyphs are the crop.
+        """
+        return self._shm.observation if self._shm is not None else None
+
     def step(self, action):
-        self._process.write(bytes((action,)))
+        if self._shm is not None:
+            if self._process.filename is not None:
+                self._process.write_record_frame(bytes((action,)), 1)
+            self._shm.send(action)
+        else:
+            self._process.write(bytes((action,)))
         message, done = self._recv()
 
         return message, done, self._info
 
+    def checkpoint(self):
+        """Returns a Checkpoint of the current game, to branch() off later.
+
+        The nethack process forks itself, copy-on-write, while it waits for
+        the next action; the copy stays paused there. The game itself goes
+        on unaffected. Needs the "shm" transport.
+        """
+        if self._shm is None:
+            raise RuntimeError("checkpoint() needs the shm transport")
+        return Checkpoint(self._shm, None)
+
+    def branch(self, checkpoint, seeds=None):
+        """Returns a new Branch off checkpoint, see there."""
+        return Branch(checkpoint, seeds)
+
+    def save_to_buffer(self):
+        """Returns the current game as bytes, for restore_from_buffer().
+
+        The whole game goes in, RNG state included, as a compressed NetHack
+        save file; it doesn't depend on this process or machine. The game
+        goes on unaffected. Needs the "shm" transport.
+        """
+        if self._shm is None:
+            raise RuntimeError("save_to_buffer() needs the shm transport")
+        return zlib.compress(self._shm.save(), 1)
+
+    def restore_from_buffer(self, state):
+        """Like reset(), but continues the game saved in state.
+
+        The restored game starts in its moveloop with NetHack's "welcome
+        back" message; menus or prompts open when the game was saved are
+        gone. With the same actions it goes on like the game that was saved.
+        Needs the "shm" transport.
+        """
+        if self._transport != "shm":
+            raise RuntimeError("restore_from_buffer() needs the shm transport")
+        state = zlib.decompress(state)
+        self._set_recordname()
+        self._process = None
+        self._process, self._shm, message = self._games.start(
+            self._vardir, self._seeds, self.recordname, state
+        )
+        return self._started(message)
+
     def close(self):
         del self._process  # Triggers finalizer.
         for f in self._finalizers:
             f()
+        self._games = None  # Ends the zygote, if any.
 
     def seed(self, seeds):
-        if isinstance(seeds, dict):
-            for k in SEED_KEYS:
-                if k not in seeds:
-                    continue
-                if seeds[k] < 1:
-                    raise ValueError(
-                        "Found %d for %s, but seeds must be positive integers.",
-                        seeds[k],
-                        k,
-                    )
-        elif seeds is not None:
-            raise ValueError("`seeds` is %s, but must be either None or a dict.", seeds)
-
+        _check_seeds(seeds)
         self._seeds = seeds
+        if self._pool is not None:
+            self._pool.seed(seeds)
 
         self._exec_nethack = functools.partial(
             _exec_nethack,
@@ -260,4 +1190,218 @@ class NetHack:
             self._vardir,
             self._seeds,
             self._nethackoptions,
+            self._observation_keys,
+            self._headless,
+            glyphs_crop=self._glyphs_crop,
+        )
+
+
+def _finalize_in_process(nethack, vardir):
+    nethack.close()
+    _remove_vardir(vardir)
+
+
+class InProcessNetHack:
+    """NetHack running inside this process via libnethack.so.
+
+    Same interface as NetHack, but without a child process, pty or ZMQ
+    socket: step() calls straight into the game and returns once NetHack
+    asks for the next key. Each instance plays in its own copy of the
+    library, so many of them can share one process. diskless is as for
+    NetHack. The size of glyphs_crop is NLE_GLYPHS_CROP ("rows,cols" or
+    "rows,cols,fill") in this process's environment, 9 by 9 if unset.
+    """
+
+    def __init__(
+        self,
+        archivefile="nethack.%(pid)i.%(time)s.zip",
+        playername="Agent%(pid)i-mon-hum-neu-mal",
+        options=None,
+        diskless=False,
+    ):
+        if options is None:
+            options = NETHACKOPTIONS
+        if not os.path.exists(DLPATH):
+            raise FileNotFoundError("Couldn't find %s." % DLPATH)
+
+        self._episode = 0
+        self._info = {}
+        self._seeds = None
+
+        self._vardir = _make_vardir(diskless)
+        self._nethack = _pynethack.Nethack(
+            DLPATH,
+            self._vardir or HACKDIR,
+            ",".join(options),
+            playername % {"pid": os.getpid()},
+            diskless,
+        )
+        self._finalizers = [
+            weakref.finalize(self, _finalize_in_process, self._nethack, self._vardir)
+        ]
+        self._observation = {
+            key: getattr(self._nethack, key)
+            for key in (
+                "glyphs",
+                "chars",
+                "colors",
+                "specials",
+                "glyphs_crop",
+                "blstats",
+                "inv_glyphs",
+                "inv_strs",
+                "inv_letters",
+                "inv_oclasses",
+            )
+        }
+        self._observation["message"] = self._nethack.message_chars
+
+        self._archive, self._recordclosefn, finalizer = _open_archive(archivefile)
+        if finalizer is not None:
+            self._finalizers.append(finalizer)
+        self._recordname = None
+
+    @property
+    def observation(self):
+        """Arrays of the last observation, as views into nle_obs.
+
+        The arrays are the same objects on every step; their contents change.
+        """
+        return self._observation
+
+    def _message(self):
+        message = Message.Message.GetRootAsMessage(self._nethack.message(), 0)
+        return message, self._nethack.done
+
+    def _close_record(self):
+        if self._recordname is not None:
+            self._recordclosefn(self._recordname)
+            self._recordname = None
+
+    def reset(self):
+        self._nethack.close()
+        self._close_record()
+        if self._archive is not None:
+            self._recordname = "nethack.run.%i.%s.%i.ttyrec" % (
+                self._episode,
+                time.strftime("%Y%m%d-%H%M%S"),
+                os.getpid(),
+            )
+
+        seeds = self._seeds or {}
+        self._nethack.reset(
+            self._recordname, seeds.get("core", 0), seeds.get("disp", 0)
+        )
+
+        message, done = self._message()
+        assert not done, "NetHack closed without input."
+
+        self._info["episode"] = self._episode
+        self._episode += 1
+        return message
+
+    def step(self, action):
+        self._nethack.step(action)
+        message, done = self._message()
+        return message, done, self._info
+
+    def close(self):
+        self._nethack.close()
+        self._close_record()
+        for f in self._finalizers:
+            f()
+
+    def seed(self, seeds):
+        _check_seeds(seeds)
+        self._seeds = seeds
+
+
+def _finalize_vector(nethack, vardirs):
+    nethack.close()
+    for vardir in vardirs:
+        _remove_vardir(vardir)
+
+
+class VectorNetHack:
+    """A batch of in-process NetHack games stepped together.
+
+    step() takes one action per game and steps all games in parallel on
+    native threads, with a single call from Python. Observations are written
+    into arrays with a leading dimension of num_envs: into arrays passed by
+    the caller, or else into arrays owned by this object which are
+    overwritten by every call. Games are past the intro when reset() or
+    step() return. A game that ends is restarted at once; done is then True
+    for it and its observation is the first one of the next episode.
+    diskless is as for NetHack.
+    """
+
+    def __init__(
+        self,
+        num_envs,
+        playername="Agent%(pid)i-mon-hum-neu-mal",
+        options=None,
+        num_threads=0,
+        diskless=False,
+    ):
+        if options is None:
+            options = NETHACKOPTIONS
+        if not os.path.exists(DLPATH):
+            raise FileNotFoundError("Couldn't find %s." % DLPATH)
+
+        self._vardirs = [_make_vardir(diskless) for _ in range(num_envs)]
+        self._nethack = _pynethack.VectorNethack(
+            DLPATH,
+            [vardir or HACKDIR for vardir in self._vardirs],
+            ",".join(options),
+            playername % {"pid": os.getpid()},
+            num_threads,
+            diskless,
+        )
+        self._finalizer = weakref.finalize(
+            self, _finalize_vector, self._nethack, self._vardirs
         )
+
+        self.glyphs = np.zeros(
+            (num_envs, _pynethack.NLE_MAP_ROWS, _pynethack.NLE_MAP_COLS),
+            dtype=np.int16,
+        )
+        self.blstats = np.zeros((num_envs, _pynethack.NLE_BLSTATS_SIZE), dtype=np.int32)
+        self.message = np.zeros((num_envs, _pynethack.NLE_MESSAGE_SIZE), dtype=np.uint8)
+        self.done = np.zeros(num_envs, dtype=bool)
+
+    def __len__(self):
+        return len(self._vardirs)
+
+    def reset(self, glyphs=None, blstats=None, message=None, seeds=None):
+        """Starts new games; returns (glyphs, blstats, message).
+
+        seeds is None, for random games, or a list of one dict of seeds (or
+        None) per game, as for NetHack.seed(). Game i plays its k-th episode since this
+        reset with its seeds plus k * num_envs, so a batch can be replayed.
+        """
+        glyphs = self.glyphs if glyphs is None else glyphs
+        blstats = self.blstats if blstats is None else blstats
+        message = self.message if message is None else message
+        core_seeds = disp_seeds = None
+        if seeds is not None:
+            if len(seeds) != len(self):
+                raise ValueError("Expected %d seeds, got %d" % (len(self), len(seeds)))
+            for game_seeds in seeds:
+                _check_seeds(game_seeds)
+            # 0 lets NetHack pick a seed that isn't given.
+            core_seeds = [(s or {}).get("core", 0) for s in seeds]
+            disp_seeds = [(s or {}).get("disp", 0) for s in seeds]
+        self._nethack.reset(glyphs, blstats, message, core_seeds, disp_seeds)
+        return glyphs, blstats, message
+
+    def step(self, actions, glyphs=None, blstats=None, message=None, done=None):
+        """Steps all games; returns (glyphs, blstats, message, done)."""
+        glyphs = self.glyphs if glyphs is None else glyphs
+        blstats = self.blstats if blstats is None else blstats
+        message = self.message if message is None else message
+        done = self.done if done is None else done
+        self._nethack.step(actions, glyphs, blstats, message, done)
+        return glyphs, blstats, message, done
+
+    def close(self):
+        self._finalizer()
@@ -94,7 +94,8 @@ def fb_ndarray_to_np(fb_ndarray):
     return result
 
 
-def print_message(message):
+def print_message(message, chars=None, colors=None):
+    """Prints the Message, with the map from chars and colors if given."""
     fb_windows = [message.Windows(i) for i in range(message.WindowsLength())]
 
     for fb_window in fb_windows:
@@ -115,6 +116,8 @@ def print_message(message):
     print("seeds", seeds)
 
     if message.NotRunning():
+        if message.Xlogfile():
+            print("xlogfile", message.Xlogfile())
         return "done"
 
     program_state = message.ProgramState()
@@ -127,15 +130,19 @@ def print_message(message):
         print("Game not in move loop.")
         return
 
+    # Parts of obs are missing unless NLE_OBSERVATION_KEYS asked for them.
     obs = message.Observation()
     status = obs.Status()
-    status_dict = {
-        field: getattr(status, field)().decode("utf-8") for field in STATUS_FIELDS
-    }
-    condition = status.Condition()
-    condition_dict = {field: getattr(condition, field)() for field in CONDITION_FIELDS}
-    print("status", status_dict)
-    print("condition", condition_dict)
+    if status is not None:
+        status_dict = {
+            field: getattr(status, field)().decode("utf-8") for field in STATUS_FIELDS
+        }
+        condition = status.Condition()
+        condition_dict = {
+            field: getattr(condition, field)() for field in CONDITION_FIELDS
+        }
+        print("status", status_dict)
+        print("condition", condition_dict)
 
     blstats = message.Blstats()
     blstats_dict = {field: getattr(blstats, field)() for field in BLSTATS_FIELDS}
@@ -168,8 +175,11 @@ def print_message(message):
         for m in messages:
             print(m)
 
-    chars = fb_ndarray_to_np(obs.Chars())
-    colors = fb_ndarray_to_np(obs.Colors())
+    if chars is None or colors is None:
+        if obs.Chars() is None or obs.Colors() is None:
+            return
+        chars = fb_ndarray_to_np(obs.Chars())
+        colors = fb_ndarray_to_np(obs.Colors())
     rows, cols = chars.shape
     nh_HE = "\033[0m"
     BRIGHT = 8
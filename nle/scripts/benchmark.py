@@ -0,0 +1,251 @@
+#!/usr/bin/env python
+#
+# Copyright (c) Facebook, Inc. and its affiliates.
+"""Latency benchmark of NetHack games, printed as JSON.
+
+Plays games with fixed seeds and fixed action traces, so that runs of the
+same build are comparable, and reports the p50/p99 latency of each phase:
+
+  spawn     reset(), up to the first key NetHack asks for
+  moveloop  from reset() until the game is in its moveloop
+  step      one step of a random walk
+  menu      opening the inventory menu
+  level     the step that digs through to the next level
+  gameover  from #quit until the game has ended
+
+Games are played as Archeologists, who start with a pick-axe to dig down
+with. Phases a game didn't get to (say, it died first) are left out; each
+phase reports how many samples it got.
+
+The same phases without Python in the way are measured by nlebench, see
+sys/unix/nlebench.c.
+"""
+import argparse
+import json
+import random
+import sys
+import timeit
+
+from nle import nethack
+
+
+PHASES = ("spawn", "moveloop", "step", "menu", "level", "gameover")
+
+PLAYERNAME = "Agent-arc-hum-neu-mal"
+
+ESC = 27
+MORE = nethack.MiscAction.MORE
+DIRECTIONS = [ord(c) for c in "kjhlyubn"]
+
+PATIENCE = 100  # Keys to give a phase before giving up.
+
+
+def make_game(backend, pool_size, diskless):
+    if backend == "inprocess":
+        return nethack.InProcessNetHack(
+            archivefile=None, playername=PLAYERNAME, diskless=diskless
+        )
+    return nethack.NetHack(
+        archivefile=None,
+        playername=PLAYERNAME,
+        zygote=backend == "zygote",
+        pool_size=pool_size if backend == "pool" else 0,
+        diskless=diskless,
+    )
+
+
+class Game:
+    """Steps a game and keeps track of its last Message."""
+
+    def __init__(self, game):
+        self.game = game
+        self.message = None
+        self.done = False
+
+    def reset(self):
+        start = timeit.default_timer()
+        self.message = self.game.reset()
+        self.done = False
+        return timeit.default_timer() - start
+
+    def step(self, key):
+        start = timeit.default_timer()
+        self.message, self.done, _ = self.game.step(key)
+        return timeit.default_timer() - start
+
+    @property
+    def in_moveloop(self):
+        return self.message.ProgramState().InMoveloop()
+
+    @property
+    def waiting(self):
+        internal = self.message.Internal()
+        return internal is not None and internal.Xwaitforspace()
+
+    @property
+    def depth(self):
+        return self.message.Blstats().Depth()
+
+    def settle(self):
+        """Dismisses --More-- until NetHack asks for a command again."""
+        for _ in range(PATIENCE):
+            if self.done or not self.waiting:
+                break
+            self.step(MORE)
+
+    def pickaxe_letter(self):
+        observation = self.message.Observation()
+        for i in range(observation.InventoryLength()):
+            item = observation.Inventory(i)
+            if b"pick-axe" in item.Str():
+                return item.Letter()
+        return None
+
+
+def dig_down(game, trace, samples):
+    depth = game.depth
+    letter = game.pickaxe_letter()
+    if letter is None:
+        return
+    for _ in range(PATIENCE // 4):
+        if game.done:
+            break
+        game.step(ord("a"))
+        game.step(letter)
+        elapsed = game.step(ord(">"))
+        # "You dig a hole through the floor.--More--" comes first.
+        while not game.done and game.waiting and game.depth == depth:
+            elapsed += game.step(MORE)
+        if game.depth != depth:
+            samples["level"].append(elapsed)
+            break
+        # Maybe on stairs or on an undiggable spot; move and retry.
+        game.step(ESC)
+        game.step(trace.choice(DIRECTIONS))
+        game.settle()
+    game.settle()
+
+
+def quit_game(game, samples):
+    game.settle()
+    elapsed = 0
+    for key in b"#quit\ry":
+        if game.done:
+            break
+        elapsed += game.step(key)
+    for _ in range(PATIENCE):
+        if game.done:
+            break
+        elapsed += game.step(ESC)
+    if game.done:
+        samples["gameover"].append(elapsed)
+
+
+def play(game, seed, steps, samples):
+    trace = random.Random(seed)
+
+    start = timeit.default_timer()
+    samples["spawn"].append(game.reset())
+
+    for _ in range(PATIENCE):
+        if game.done or game.in_moveloop:
+            break
+        game.step(MORE if game.waiting else ESC)
+    if game.in_moveloop:
+        samples["moveloop"].append(timeit.default_timer() - start)
+
+    for _ in range(steps):
+        if game.done:
+            break
+        if game.waiting:
+            game.step(MORE)
+            continue
+        samples["step"].append(game.step(trace.choice(DIRECTIONS)))
+
+    game.settle()
+    if not game.done:
+        samples["menu"].append(game.step(ord("i")))
+        game.step(ESC)
+        game.settle()
+
+    if not game.done:
+        dig_down(game, trace, samples)
+    if not game.done:
+        quit_game(game, samples)
+
+
+def percentile(sorted_samples, p):
+    """Nearest-rank percentile, as in nlebench."""
+    if not sorted_samples:
+        return 0.0
+    rank = int(p / 100 * len(sorted_samples) + 0.5)
+    return sorted_samples[min(max(rank, 1), len(sorted_samples)) - 1]
+
+
+def summarize(samples):
+    result = {}
+    for phase in PHASES:
+        us = sorted(s * 1e6 for s in samples[phase])
+        result[phase] = {
+            "n": len(us),
+            "p50_us": round(percentile(us, 50), 1),
+            "p99_us": round(percentile(us, 99), 1),
+            "max_us": round(us[-1], 1) if us else 0.0,
+        }
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument(
+        "--backend",
+        choices=("process", "zygote", "pool", "inprocess"),
+        default="process",
+        help="How games are run; zygote and pool are NetHack's options.",
+    )
+    parser.add_argument("-g", "--games", type=int, default=100)
+    parser.add_argument(
+        "-k", "--steps", type=int, default=1000, help="Random walk steps per game."
+    )
+    parser.add_argument(
+        "-s", "--seed", type=int, default=1, help="Games get seeds seed, seed + 1, ..."
+    )
+    parser.add_argument("--pool_size", type=int, default=4)
+    parser.add_argument("--diskless", action="store_true")
+    parser.add_argument("-o", "--output", help="Write the JSON here, not to stdout.")
+    flags = parser.parse_args()
+
+    samples = {phase: [] for phase in PHASES}
+    game = Game(make_game(flags.backend, flags.pool_size, flags.diskless))
+    try:
+        if flags.backend == "pool":
+            # New seeds would drop the games the pool has ready, so these
+            # all get the same game and only the traces differ.
+            game.game.seed({"core": flags.seed, "disp": flags.seed})
+        for i in range(flags.games):
+            seed = flags.seed + i
+            if flags.backend != "pool":
+                game.game.seed({"core": seed, "disp": seed})
+            play(game, seed, flags.steps, samples)
+    finally:
+        game.game.close()
+
+    result = {
+        "harness": "benchmark.py",
+        "backend": flags.backend,
+        "games": flags.games,
+        "steps": flags.steps,
+        "seed": flags.seed,
+        "phases": summarize(samples),
+    }
+    if flags.output:
+        with open(flags.output, "w") as f:
+            json.dump(result, f, indent=2)
+            f.write("\n")
+    else:
+        json.dump(result, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
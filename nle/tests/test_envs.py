@@ -10,6 +10,148 @@ import gym
 
 import nle
 import nle.env
+from nle.nethack import _pynethack
+
+
+# Observations decoded from the Message flatbuffer in Python, as NLE did
+# before helper.decode_into() and nle_obs.
+
+
+def _fb_ndarray_to_np(fb_ndarray):
+    result = fb_ndarray.DataAsNumpy()
+    result = result.view(np.typeDict[fb_ndarray.Dtype()])
+    result = result.reshape(fb_ndarray.ShapeAsNumpy().tolist())
+    return result
+
+
+INVFIELDS = [
+    "Glyph",
+    "Str",
+    "Letter",
+    "ObjectClass",
+    # "ObjectClassName",
+]
+
+
+
+def _get_glyphs(response):
+    if response is None:
+        return np.zeros(nle.env.DUNGEON_SHAPE, dtype=np.int16)
+    o = response.Observation()
+    # If done is True, Observation() is None.
+    if o is None:
+        return np.zeros(nle.env.DUNGEON_SHAPE, dtype=np.int16)
+    return o.Glyphs().DataAsNumpy().view(np.int16).reshape(nle.env.DUNGEON_SHAPE)
+
+
+def _get_glyphs_crop(response, shape):
+    o = response.Observation() if response is not None else None
+    # If done is True, Observation() is None.
+    if o is None or o.GlyphsCrop() is None:
+        return np.zeros(shape, dtype=np.int16)
+    return _fb_ndarray_to_np(o.GlyphsCrop())
+
+
+def _get_status_fast(response, entries=23):
+    # In the order of nle_obs.blstats, see include/nleobs.h.
+    s = response.Blstats()
+    if s is None:
+        return np.zeros(entries, dtype=np.int32)
+    return np.frombuffer(
+        s._tab.Bytes[s._tab.Pos : s._tab.Pos + 4 * entries], dtype=np.int32
+    )
+
+
+def _get_padded_message(
+    response,
+    padded_length=nle.env.base.DEFAULT_MSG_PAD,
+    alphabet_size=ord("~") - ord(" ") + 1,
+):
+    result = np.full(padded_length, fill_value=alphabet_size, dtype=np.uint8)
+    if response is None or response.NotRunning():
+        return result
+
+    win = response.Windows(nle.env.base.WIN_MESSAGE)
+    assert win is not None and win.Type() == nle.nethack.NHW_MESSAGE
+
+    offset = 0
+    for i in range(win.StringsLength()):
+        message = np.frombuffer(win.Strings(i), dtype=np.uint8)
+
+        # Subtract ord(" ") and assign. Crop if space runs out.
+        result[offset : offset + len(message)] = (
+            message[: max(len(result) - offset, 0)] - 0x20
+        )
+        offset += len(message) + 1  # Keep one separation token.
+    return result
+
+
+def _get_inv(response):
+    result = {}
+    for field in INVFIELDS:
+        result[field] = []
+
+    o = response.Observation()
+    if o is None:
+        return result
+
+    for item in (o.Inventory(i) for i in range(o.InventoryLength())):
+        for field in INVFIELDS:
+            result[field].append(getattr(item, field)())
+    return result
+
+
+def _get_padded_inv(
+    response,
+    padded_length=nle.env.base.DEFAULT_INV_PAD,
+    str_padded_length=nle.env.base.DEFAULT_INVSTR_PAD,
+    alphabet_size=ord("~") - ord(" ") + 1,
+):
+    inv = _get_inv(response)
+    strs = np.full(
+        (padded_length, str_padded_length), fill_value=alphabet_size, dtype=np.uint8
+    )
+    for i, b in enumerate(inv["Str"]):
+        strs[i, : len(b)] = np.frombuffer(b, dtype=np.uint8)[:str_padded_length] - 0x20
+
+    pad_width = (0, padded_length - len(inv["Str"]))
+    glyphs = np.pad(
+        np.asarray(inv["Glyph"], dtype=np.int16),
+        pad_width,
+        mode="constant",
+        constant_values=nle.nethack.NO_GLYPH,
+    )
+    letters = np.pad(
+        np.asarray(inv["Letter"], dtype=np.uint8) - 0x20,
+        pad_width,
+        mode="constant",
+        constant_values=alphabet_size,
+    )
+    oclasses = np.pad(
+        np.asarray(inv["ObjectClass"], dtype=np.uint8),
+        pad_width,
+        mode="constant",
+        constant_values=nle.nethack.MAXOCLASSES,
+    )
+
+    return glyphs, strs, letters, oclasses
+
+
+def _decode_message(env, response):
+    """An observation of env decoded from the Message in Python.
+
+    The reference for helper.decode_into() and the shared-memory views.
+    """
+    decoders = {
+        "glyphs": _get_glyphs,
+        "glyphs_crop": lambda response: _get_glyphs_crop(
+            response, env.observation_space["glyphs_crop"].shape
+        ),
+        "status": _get_status_fast,
+        "message": _get_padded_message,
+        "inventory": _get_padded_inv,
+    }
+    return {key: decoders[key](response) for key in env._view_functions}
 
 
 def get_nethack_env_ids():
@@ -204,3 +346,107 @@ class TestGymEnvRollout:
             output = env.render(mode="ansi")
             assert isinstance(output, str)
             assert len(output.replace("\n", "")) == np.prod(nle.env.DUNGEON_SHAPE)
+
+    @pytest.mark.parametrize("transport", ["shm", "zmq"])
+    def test_render(self, env_name, rollout_len, transport, capsys):
+        """Tests that both render modes draw the map, whatever the transport."""
+        rows, cols = nle.env.DUNGEON_SHAPE
+        env = gym.make(env_name, transport=transport)
+        env.reset()
+        assert "@" in env.render(mode="ansi")
+        for _ in range(rollout_len):
+            lines = env.render(mode="ansi").split("\n")
+            assert [len(line) for line in lines] == [cols] * rows
+
+            capsys.readouterr()
+            env.render(mode="human")
+            # Each character of the map is drawn in its color, then reset.
+            assert capsys.readouterr().out.count("\033[0m") == rows * cols
+
+            _, _, done, _ = env.step(env.action_space.sample())
+            if done:
+                break
+        env.close()
+
+    def test_observation_views(self, env_name, rollout_len):
+        """Tests that shared-memory views match the Message flatbuffer."""
+        env = gym.make(env_name)
+        obs = env.reset()
+        for _ in range(rollout_len):
+            from_message = _decode_message(env, env.response)
+            np.testing.assert_equal(obs, from_message)
+            obs, _, done, _ = env.step(env.action_space.sample())
+            if done:
+                break
+        env.close()
+
+    def test_zero_copy(self, env_name, rollout_len):
+        """Tests that observations only alias shared memory with zero_copy."""
+        env = gym.make(env_name)
+        obs = env.reset()
+        assert not np.shares_memory(obs["glyphs"], env.env.observation["glyphs"])
+        kept = {key: np.copy(value) for key, value in obs.items()}
+        for _ in range(2 * _pynethack.NLE_SHM_SLOTS):
+            _, _, done, _ = env.step(env.action_space.sample())
+            if done:
+                break
+        np.testing.assert_equal(obs, kept)
+        env.close()
+
+        env = gym.make(env_name, zero_copy=True)
+        obs = env.reset()
+        observation = env.env.observation
+        assert np.shares_memory(obs["glyphs"], observation["glyphs"])
+        # Text as in nle_obs, NUL-padded; bytes - 0x20 padded with 95 otherwise.
+        np.testing.assert_equal(obs["message"], observation["message"])
+        np.testing.assert_equal(
+            nle.env.base._shift_text(obs["message"]),
+            _get_padded_message(env.response),
+        )
+        env.close()
+
+    def test_glyphs_crop(self, env_name, rollout_len):
+        """Tests glyphs_crop against a crop of glyphs around the hero."""
+        rows, cols = 5, 7
+        env = gym.make(
+            env_name,
+            observation_keys=("glyphs", "glyphs_crop", "status"),
+            glyphs_crop=(rows, cols),
+        )
+        obs = env.reset()
+        for _ in range(rollout_len):
+            x, y = obs["status"][:2]
+            # Solid rock, S_stone, off the map.
+            padded = np.pad(
+                obs["glyphs"],
+                ((rows, rows), (cols, cols)),
+                constant_values=nle.nethack.GLYPH_CMAP_OFF,
+            )
+            top, left = y + rows - rows // 2, x + cols - cols // 2
+            np.testing.assert_equal(
+                obs["glyphs_crop"], padded[top : top + rows, left : left + cols]
+            )
+            np.testing.assert_equal(
+                obs["glyphs_crop"],
+                _get_glyphs_crop(env.response, (rows, cols)),
+            )
+            obs, _, done, _ = env.step(env.action_space.sample())
+            if done:
+                break
+        env.close()
+
+    def test_decode_into(self, env_name, rollout_len):
+        """Tests that helper.decode_into() matches the Python decoding."""
+        env = gym.make(env_name)
+        env.reset()
+        for _ in range(rollout_len):
+            from_message = _decode_message(env, env.response)
+            decoded = env._decode_observation(env.response)
+            np.testing.assert_equal(
+                {key: f(decoded) for key, f in env._view_functions.items()},
+                from_message,
+            )
+            _, _, done, _ = env.step(env.action_space.sample())
+            if done:
+                break
+        env.close()
@@ -15,10 +15,22 @@ def _fb_ndarray_to_np(fb_ndarray):
     return result
 
 
+def _play_to_moveloop(game, response):
+    """Steps past --More-- until the game is in its move loop.
+
+    Returns (response, done, info) as step() does, info as of reset() if
+    the game was there already.
+    """
+    done, info = False, game._info
+    while not response.ProgramState().InMoveloop():
+        response, done, info = game.step(nethack.MiscAction.MORE)
+    return response, done, info
+
+
 class NetHackTest(unittest.TestCase):
-    def test_run(self):
+    def run_game(self, **kwargs):
         archivefile = tempfile.mktemp(suffix="nethack_test", prefix=".zip")
-        game = nethack.NetHack(archivefile=archivefile)
+        game = nethack.NetHack(archivefile=archivefile, **kwargs)
 
         response = game.reset()
         actions = [
@@ -64,6 +76,444 @@ class NetHackTest(unittest.TestCase):
         with self.assertRaisesRegex(OSError, "No (child|such)? process"):
             os.waitpid(info["pid"], 0)
 
+    def test_run(self):
+        self.run_game()
+
+    def test_run_shm(self):
+        self.run_game(transport="shm")
+
+    def test_shm_observation(self):
+        game = nethack.NetHack(archivefile=None, transport="shm")
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+
+        # The ring lives in memory only, not in a file of the HACKDIR.
+        self.assertEqual(
+            [f for f in os.listdir(game._vardir) if f.endswith(".nle.shm")], []
+        )
+
+        last_glyphs = None
+        for _ in range(10):
+            response, done, info = game.step(ord("s"))  # Search.
+            observation = game.observation
+            np.testing.assert_array_equal(
+                observation["glyphs"],
+                _fb_ndarray_to_np(response.Observation().Glyphs()),
+            )
+            if last_glyphs is not None:
+                # The previous step's arrays are still intact.
+                np.testing.assert_array_equal(last_glyphs, last_glyphs_copy)
+            last_glyphs = observation["glyphs"]
+            last_glyphs_copy = last_glyphs.copy()
+        game.close()
+
+    def test_observation_keys(self):
+        game = nethack.NetHack(
+            archivefile=None, transport="shm", observation_keys=("glyphs",)
+        )
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+
+        obs = response.Observation()
+        self.assertIsNotNone(obs.Glyphs())
+        self.assertIsNone(obs.Chars())
+        self.assertIsNone(obs.Status())
+        self.assertEqual(obs.InventoryLength(), 0)
+        self.assertIsNotNone(response.Blstats())
+
+        # The shared-memory arrays don't depend on observation_keys.
+        status = response.Blstats()
+        x, y = status.CursX(), status.CursY()
+        self.assertEqual(game.observation["chars"][y, x], ord("@"))
+        game.close()
+
+        with self.assertRaisesRegex(ValueError, "Unknown observation key"):
+            nethack.NetHack(archivefile=None, observation_keys=("message",))
+
+    def test_headless(self):
+        game = nethack.NetHack(archivefile=None, transport="shm", headless=True)
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+
+        status = response.Blstats()
+        x, y = status.CursX(), status.CursY()
+        self.assertEqual(game.observation["chars"][y, x], ord("@"))
+
+        def call_stack(response):
+            internal = response.Internal()
+            return [internal.CallStack(i) for i in range(internal.CallStackLength())]
+
+        # Prompts work without the tty port.
+        response, done, info = game.step(ord("#"))
+        self.assertIn(b"get_ext_cmd", call_stack(response))
+        for c in b"pray\r":
+            response, done, info = game.step(c)
+        self.assertIn(b"yn_function", call_stack(response))
+        response, done, info = game.step(ord("n"))
+        self.assertFalse(done)
+        game.close()
+
+    def test_zygote(self):
+        game = nethack.NetHack(archivefile=None, zygote=True, headless=True)
+        seeds = {"core": 42, "disp": 123}
+        pids, glyphs = [], []
+        for _ in range(2):
+            game.seed(seeds)
+            response = game.reset()
+            response, done, info = _play_to_moveloop(game, response)
+            pids.append(info["pid"])
+            glyphs.append(game.observation["glyphs"].copy())
+            response, done, info = game.step(ord("s"))
+            self.assertFalse(done)
+        self.assertNotEqual(pids[0], pids[1])
+        np.testing.assert_array_equal(glyphs[0], glyphs[1])
+        game.close()
+
+        with self.assertRaisesRegex(ValueError, "shm transport"):
+            nethack.NetHack(archivefile=None, zygote=True, transport="zmq")
+
+    def test_reuse(self):
+        game = nethack.NetHack(archivefile=None, reuse=True, headless=True)
+        seeds = {"core": 42, "disp": 123}
+        pids, glyphs = [], []
+        for _ in range(3):
+            game.seed(seeds)
+            response = game.reset()
+            response, done, info = _play_to_moveloop(game, response)
+            pids.append(info["pid"])
+            glyphs.append(game.observation["glyphs"].copy())
+            for c in b"#quit\ry":
+                response, done, info = game.step(c)
+            for _ in range(100):
+                if done:
+                    break
+                response, done, info = game.step(27)  # ESC through disclosure.
+            self.assertTrue(done)
+        self.assertEqual(pids, pids[:1] * 3)
+        for other in glyphs[1:]:
+            np.testing.assert_array_equal(glyphs[0], other)
+
+        # A game reset before it is over ends its process.
+        game.reset()
+        self.assertEqual(info["pid"], pids[0])
+        game.reset()
+        self.assertNotEqual(info["pid"], pids[0])
+        game.close()
+
+        with self.assertRaisesRegex(ValueError, "shm transport"):
+            nethack.NetHack(archivefile=None, reuse=True, transport="zmq")
+        with self.assertRaisesRegex(ValueError, "zygote"):
+            nethack.NetHack(archivefile=None, reuse=True, zygote=True)
+
+    @unittest.skipUnless(os.path.isdir("/proc/self/fd"), "needs /proc")
+    def test_reuse_resources(self):
+        # Each reset copies the process's globals back; several in a row
+        # must leave its stdio working and not leak file descriptors.
+        game = nethack.NetHack(archivefile=None, reuse=True, headless=False)
+        pids, fds, written = [], [], []
+        for _ in range(5):
+            response = game.reset()
+            response, done, info = _play_to_moveloop(game, response)
+            pid = info["pid"]
+            pids.append(pid)
+            fds.append(sorted(os.listdir("/proc/%i/fd" % pid)))
+            with open("/proc/%i/io" % pid) as f:
+                wchar = int(dict(line.split(": ") for line in f)["wchar"])
+            for c in b"#quit\ry":
+                response, done, info = game.step(c)
+            for _ in range(100):
+                if done:
+                    break
+                response, done, info = game.step(27)  # ESC through disclosure.
+            self.assertTrue(done)
+            written.append(wchar)
+        self.assertEqual(pids, pids[:1] * 5)
+        self.assertEqual(fds, fds[:1] * 5)
+        # The tty draws each game's map on stdout, well over a byte a step.
+        for before, after in zip(written, written[1:]):
+            self.assertGreater(after - before, 1000)
+        game.close()
+
+    def test_pool(self):
+        game = nethack.NetHack(archivefile=None, pool_size=2, zygote=True)
+        game.seed({"core": 42, "disp": 123})
+        glyphs = []
+        for _ in range(3):
+            response = game.reset()
+            self.assertTrue(response.ProgramState().InMoveloop())
+            glyphs.append(game.observation["glyphs"].copy())
+            response, done, info = game.step(ord("s"))
+            self.assertFalse(done)
+        for other in glyphs[1:]:
+            np.testing.assert_array_equal(glyphs[0], other)
+        game.close()
+
+        with self.assertRaisesRegex(ValueError, "shm transport"):
+            nethack.NetHack(archivefile=None, pool_size=2, transport="zmq")
+
+    def test_branch(self):
+        game = nethack.NetHack(archivefile=None, transport="shm")
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+
+        checkpoint = game.checkpoint()
+        np.testing.assert_array_equal(
+            checkpoint.observation["glyphs"], game.observation["glyphs"]
+        )
+        branches = [game.branch(checkpoint) for _ in range(2)]
+        actions = [ord(c) for c in "hjklyubn" * 5]
+        for action in actions:
+            game.step(action)
+            for branch in branches:
+                response, done, info = branch.step(action)
+                self.assertFalse(done)
+                np.testing.assert_array_equal(
+                    branch.observation["glyphs"], game.observation["glyphs"]
+                )
+
+        # Branches and the checkpoint outlive each other.
+        checkpoint.close()
+        branches[0].close()
+        response, done, info = branches[1].step(ord("s"))
+        self.assertFalse(done)
+        game.close()
+
+        with self.assertRaisesRegex(RuntimeError, "shm transport"):
+            nethack.NetHack(archivefile=None).checkpoint()  # zmq by default.
+
+    def test_save_to_buffer(self):
+        game = nethack.NetHack(archivefile=None, transport="shm")
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+
+        state = game.save_to_buffer()
+        restored = [
+            nethack.NetHack(archivefile=None, transport="shm") for _ in range(2)
+        ]
+        for other in restored:
+            response = other.restore_from_buffer(state)
+            self.assertTrue(response.ProgramState().InMoveloop())
+
+        # The saved game goes on, and so do the restored ones, alike.
+        actions = [ord(c) for c in "hjklyubn" * 5]
+        for action in actions:
+            response, done, info = game.step(action)
+            self.assertFalse(done)
+            for other in restored:
+                other.step(action)
+                np.testing.assert_array_equal(
+                    other.observation["glyphs"], game.observation["glyphs"]
+                )
+
+        for other in restored:
+            other.close()
+        game.close()
+
+        with self.assertRaisesRegex(RuntimeError, "shm transport"):
+            nethack.NetHack(archivefile=None, transport="zmq").save_to_buffer()
+
+    def test_save_to_buffer_leaves_game(self):
+        seeds = {"core": 42, "disp": 123}
+        games = []
+        for _ in range(2):
+            game = nethack.NetHack(archivefile=None, transport="shm")
+            game.seed(seeds)
+            response = game.reset()
+            response, done, info = _play_to_moveloop(game, response)
+            games.append(game)
+        snapshotted, untouched = games
+
+        # The same game, snapshotted on every step or never.
+        rng = np.random.RandomState(0)
+        actions = [ord(c) for c in "hjklyubn.s"]
+        for action in rng.choice(actions, 200):
+            snapshotted.save_to_buffer()
+            for game in games:
+                response, done, info = game.step(int(action))
+            if done:
+                break
+            for key in ("glyphs", "blstats", "message", "inv_strs"):
+                np.testing.assert_array_equal(
+                    snapshotted.observation[key], untouched.observation[key]
+                )
+
+        for game in games:
+            game.close()
+
+    def test_diskless(self):
+        game = nethack.NetHack(archivefile=None, diskless=True)
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+        lock = "%iAgent%i.0" % (os.getuid(), info["pid"])
+        self.assertFalse(os.path.exists(os.path.join(nethack.HACKDIR, lock)))
+
+        for c in b"#quit\ry":
+            response, done, info = game.step(c)
+        for _ in range(100):
+            if done:
+                break
+            response, done, info = game.step(27)  # ESC through disclosure.
+        self.assertTrue(done)
+        self.assertIn(b"\tdeath=quit\t", response.Xlogfile())
+        game.close()
+
+        with self.assertRaisesRegex(ValueError, "shm transport"):
+            nethack.NetHack(archivefile=None, diskless=True, transport="zmq")
+
+    def test_map_delta(self):
+        game = nethack.NetHack(
+            archivefile=None,
+            observation_keys=("glyphs", "chars", "colors", "specials", "map_delta"),
+        )
+        buffer = nethack.MapBuffer()
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+
+        for i in range(250):
+            self.assertTrue(buffer.update(response))  # Starts with a keyframe.
+            obs = response.Observation()
+            np.testing.assert_array_equal(
+                buffer.glyphs, _fb_ndarray_to_np(obs.Glyphs())
+            )
+            np.testing.assert_array_equal(buffer.chars, _fb_ndarray_to_np(obs.Chars()))
+            np.testing.assert_array_equal(
+                buffer.colors, _fb_ndarray_to_np(obs.Colors())
+            )
+            np.testing.assert_array_equal(
+                buffer.specials, _fb_ndarray_to_np(obs.Specials())
+            )
+            if not obs.MapDelta().Keyframe():
+                # Only what changed, not the whole map.
+                self.assertLess(obs.MapDelta().CellsLength(), buffer.glyphs.size)
+
+            action = nethack.ACTIONS[i % 8]  # Compass directions.
+            response, done, info = game.step(action)
+            if done:
+                break
+        game.close()
+
+
+class InProcessNetHackTest(unittest.TestCase):
+    def test_run(self):
+        archivefile = tempfile.mktemp(suffix="nethack_test", prefix=".zip")
+        game = nethack.InProcessNetHack(archivefile=archivefile)
+
+        response = game.reset()
+        response, done, info = _play_to_moveloop(game, response)
+        self.assertFalse(done)
+
+        for _ in range(20):
+            response, done, info = game.step(ord("s"))  # Search.
+            if done:
+                response = game.reset()
+                continue
+
+            status = response.Blstats()
+            x, y = status.CursX(), status.CursY()
+            chars = _fb_ndarray_to_np(response.Observation().Chars())
+            self.assertEqual(chars[y, x], ord("@"))
+
+        self.assertEqual(info["episode"], 0)
+        game.close()
+
+    def test_side_by_side(self):
+        games = [nethack.InProcessNetHack(archivefile=None) for _ in range(2)]
+        for game in games:
+            game.seed({"core": 42, "disp": 42})
+
+        responses = [game.reset() for game in games]
+        for _ in range(50):
+            responses = [game.step(ord("j"))[0] for game in games]
+            chars = [_fb_ndarray_to_np(r.Observation().Chars()) for r in responses]
+            # Same seeds, same actions: the games don't share any state.
+            np.testing.assert_array_equal(chars[0], chars[1])
+
+        for game in games:
+            game.close()
+
+    def test_reset_reuses_library(self):
+        game = nethack.InProcessNetHack(archivefile=None)
+        game.seed({"core": 42, "disp": 42})
+        chars = []
+        for _ in range(3):
+            # Later resets reset the library's globals rather than reload it.
+            response = game.reset()
+            for _ in range(50):
+                response, done, info = game.step(ord("j"))
+            chars.append(_fb_ndarray_to_np(response.Observation().Chars()))
+        for other in chars[1:]:
+            np.testing.assert_array_equal(chars[0], other)
+        game.close()
+
+    def test_glyphmap(self):
+        # The rl port maps glyphs by table. It must agree with mapglyph()
+        # for every glyph away from the hero, with color on and off.
+        game = nethack.InProcessNetHack(archivefile=None)
+        game.reset()
+        if game._nethack._check_glyphmap() < 0:
+            game.close()
+            self.skipTest("libnethack.so built without EXTRA_SANITY_CHECKS")
+        for _ in range(20):
+            _, done, _ = game.step(ord("s"))  # Search.
+            self.assertEqual(game._nethack._check_glyphmap(), 0)
+            if done:
+                break
+        game.close()
+
+
+class VectorNetHackTest(unittest.TestCase):
+    def test_step(self):
+        games = nethack.VectorNetHack(4, num_threads=2)
+        glyphs, blstats, message = games.reset()
+        self.assertEqual(glyphs.shape, (4, 21, 79))
+        self.assertEqual(blstats.shape, (4, 23))
+
+        actions = np.full(len(games), ord("s"))  # Search.
+        for _ in range(20):
+            glyphs, blstats, message, done = games.step(actions)
+            self.assertFalse(done.any())
+        self.assertTrue((blstats[:, 20] > 1).all())  # Time.
+
+        # The player is a monster glyph where the status says it is.
+        for i in range(len(games)):
+            x, y = blstats[i, :2]
+            self.assertLess(glyphs[i, y, x], nethack.GLYPH_PET_OFF)
+        games.close()
+
+    def test_seeds(self):
+        seeds = [{"core": 42, "disp": 123}, {"core": 7, "disp": 8}]
+        actions = np.full(2, ord("s"))  # Search.
+        runs = []
+        for _ in range(2):
+            games = nethack.VectorNetHack(2, num_threads=2)
+            games.reset(seeds=seeds)
+            for _ in range(5):
+                games.step(actions)
+            runs.append((games.glyphs.copy(), games.blstats.copy()))
+            games.close()
+
+        np.testing.assert_array_equal(runs[0][0], runs[1][0])
+        np.testing.assert_array_equal(runs[0][1], runs[1][1])
+        self.assertFalse(np.array_equal(runs[0][0][0], runs[0][0][1]))
+
+        games = nethack.VectorNetHack(2, num_threads=1)
+        with self.assertRaises(ValueError):
+            games.reset(seeds=seeds[:1])
+        games.close()
+
+    def test_caller_arrays(self):
+        games = nethack.VectorNetHack(2, num_threads=1)
+        blstats = np.zeros((2, 23), dtype=np.int32)
+        _, result, _ = games.reset(blstats=blstats)
+        self.assertIs(result, blstats)
+        self.assertTrue(blstats.any())
+
+        with self.assertRaises(TypeError):
+            games.step(np.zeros(2), blstats=np.zeros((2, 23)))  # float64.
+        with self.assertRaises(ValueError):
+            games.step(np.zeros(3))
+        games.close()
+
 
 class HelperTest(unittest.TestCase):
     def test_simple(self):
@@ -81,6 +531,45 @@ class HelperTest(unittest.TestCase):
         self.assertEqual(nethack.NHW_MESSAGE, 1)
         self.assertTrue(hasattr(nethack, "MAXWIN"))
 
+    def test_decompose_glyphs(self):
+        lichen = 155
+        glyphs = np.array(
+            [
+                [lichen, nethack.GLYPH_PET_OFF + lichen],
+                [nethack.GLYPH_OBJ_OFF + 1, nethack.GLYPH_CMAP_OFF + 2],
+                [nethack.NO_GLYPH, -1],
+            ],
+            dtype=np.int16,
+        )
+
+        groups, ids = nethack.decompose_glyphs(glyphs)
+        self.assertEqual(groups.shape, glyphs.shape)
+        self.assertEqual(groups.dtype, np.uint8)
+        self.assertEqual(ids.dtype, np.int16)
+        np.testing.assert_array_equal(
+            groups,
+            [
+                [nethack.GLYPH_GROUP_MON, nethack.GLYPH_GROUP_PET],
+                [nethack.GLYPH_GROUP_OBJ, nethack.GLYPH_GROUP_CMAP],
+                [nethack.GLYPH_GROUP_NONE, nethack.GLYPH_GROUP_NONE],
+            ],
+        )
+        np.testing.assert_array_equal(ids, [[lichen, lichen], [1, 2], [0, 0]])
+
+        _, _, mlets, oc_classes = nethack.decompose_glyphs(glyphs, classes=True)
+        mlet = ord(nethack.glyph_to_mon(lichen).mlet)
+        np.testing.assert_array_equal(
+            mlets,
+            [
+                [mlet, mlet],
+                [nethack.MAXMCLASSES, nethack.MAXMCLASSES],
+                [nethack.MAXMCLASSES, nethack.MAXMCLASSES],
+            ],
+        )
+        np.testing.assert_array_equal(
+            oc_classes[1], [nethack.WEAPON_CLASS, nethack.MAXOCLASSES]
+        )
+
 
 if __name__ == "__main__":
     unittest.main()
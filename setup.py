@@ -110,6 +110,10 @@ ext_modules = [
             get_pybind_include(),
             get_pybind_include(user=True),
             "include",
+            # flatbuffers, found there when building NetHack too.
+            os.path.join(
+                os.getenv("PREFIX", sysconfig.get_config_var("base")), "include"
+            ),
         ],
         language="c++",
         # Warning: This should stay in sync with the Makefiles, otherwise
@@ -117,8 +121,21 @@ ext_modules = [
         # if the MAIL macro is set.
         extra_compile_args=["-DNOCLIPPING", "-DNOMAIL", "-DNOTPARMDECL"],
         # This requires `make`ing NetHack before.
-        extra_link_args=["src/monst.o", "src/decl.o", "src/drawing.o"],
-    )
+        extra_link_args=[
+            "src/monst.o",
+            "src/decl.o",
+            "src/drawing.o",
+            "src/objects.o",
+        ],
+    ),
+    setuptools.Extension(
+        "nle.nethack._pynethack",
+        ["win/rl/pynethack.cc", "sys/unix/nledl.c"],
+        include_dirs=[get_pybind_include(), get_pybind_include(user=True), "include"],
+        language="c++",
+        # Loads copies of libnethack.so from HACKDIR, see include/nledl.h.
+        libraries=["dl"],
+    ),
 ]
 
 
@@ -184,6 +201,7 @@ packages = [
 entry_points = {
     "console_scripts": [
         "nle-play = nle.scripts.play:main",
+        "nle-benchmark = nle.scripts.benchmark:main",
         "nle-ttyrec = nle.scripts.ttyrec:main",
         "nle-ttyplay = nle.scripts.ttyplay:main",
     ]
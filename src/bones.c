@@ -348,6 +348,9 @@ can_make_bones()
        in bones files */
     if (discover)
         return FALSE;
+    /* NLE: no bones files; checked last to leave the rn2() calls alone */
+    if (iflags.diskless)
+        return FALSE;
     return TRUE;
 }
 
@@ -590,7 +593,7 @@ getbones()
     if (rn2(3) /* only once in three times do we find bones */
         && !wizard)
         return 0;
-    if (no_bones_level(&u.uz))
+    if (no_bones_level(&u.uz) || iflags.diskless)
         return 0;
     fd = open_bonesfile(&u.uz, &bonesid);
     if (fd < 0)
@@ -12,6 +12,11 @@
 #include <string.h>
 #endif
 
+#ifdef DLBMMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #define DATAPREFIX 4
 
 #if defined(OVERLAY)
@@ -80,6 +85,10 @@ STATIC_DCL int FDECL(lib_dlb_fseek, (dlb *, long, int));
 STATIC_DCL char *FDECL(lib_dlb_fgets, (char *, int, dlb *));
 STATIC_DCL int FDECL(lib_dlb_fgetc, (dlb *));
 STATIC_DCL long FDECL(lib_dlb_ftell, (dlb *));
+#ifdef DLBMMAP
+STATIC_DCL void FDECL(map_library, (library * lp));
+STATIC_DCL boolean NDECL(lib_dlb_mapped);
+#endif
 
 /* not static because shared with dlb_main.c */
 boolean FDECL(open_library, (const char *lib_name, library *lp));
@@ -175,6 +184,36 @@ library *lp; /* library pointer to fill in */
     return TRUE;
 }
 
+#ifdef DLBMMAP
+/*
+ * Map the whole library file, if possible, for reads to be copies out of
+ * the page cache instead of going through stdio.  The mapping is shared
+ * by every process with the file open, and forked processes inherit it:
+ * a zygote maps nhdat once for all its games.  If the file can't be
+ * mapped, or is shorter than its directory claims, reads use stdio.
+ */
+STATIC_OVL void
+map_library(lp)
+library *lp;
+{
+    struct stat st;
+    libdir *last = &lp->dir[lp->nentries - 1];
+    void *m;
+
+    lp->mdata = (char *) 0;
+    lp->msize = 0;
+    if (fstat(fileno(lp->fdata), &st) < 0 || st.st_size <= 0
+        || (long) st.st_size < last->foffset + last->fsize)
+        return;
+    m = mmap((void *) 0, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+             fileno(lp->fdata), 0);
+    if (m == MAP_FAILED)
+        return;
+    lp->mdata = (char *) m;
+    lp->msize = (long) st.st_size;
+}
+#endif
+
 /*
  * Look for the file in our directory structure.  Return 1 if successful,
  * 0 if not found.  Fill in the size and starting position.
@@ -218,6 +257,9 @@ library *lp;
     lp->fdata = fopen_datafile(lib_name, RDBMODE, DATAPREFIX);
     if (lp->fdata) {
         if (readlibdir(lp)) {
+#ifdef DLBMMAP
+            map_library(lp);
+#endif
             status = TRUE;
         } else {
             (void) fclose(lp->fdata);
@@ -231,6 +273,10 @@ void
 close_library(lp)
 library *lp;
 {
+#ifdef DLBMMAP
+    if (lp->mdata)
+        (void) munmap((genericptr_t) lp->mdata, (size_t) lp->msize);
+#endif
     (void) fclose(lp->fdata);
     free((genericptr_t) lp->dir);
     free((genericptr_t) lp->sspace);
@@ -328,6 +374,15 @@ dlb *dp;
     if (quan == 0)
         return 0;
 
+#ifdef DLBMMAP
+    if (dp->lib->mdata) {
+        nbytes = (long) quan * size;
+        (void) memcpy(buf, dp->lib->mdata + dp->start + dp->mark,
+                      (size_t) nbytes);
+        dp->mark += nbytes;
+        return quan;
+    }
+#endif
     pos = dp->start + dp->mark;
     if (dp->lib->fmark != pos) {
         fseek(dp->lib->fdata, pos, SEEK_SET); /* check for error??? */
@@ -387,6 +442,20 @@ dlb *dp;
         return (char *) 0;
 
     len--; /* save room for null */
+#ifdef DLBMMAP
+    if (dp->lib->mdata) {
+        const char *src = dp->lib->mdata + dp->start + dp->mark, *nl;
+        long n = dp->size - dp->mark;
+
+        if (n > len)
+            n = len;
+        if ((nl = (const char *) memchr(src, '\n', (size_t) n)) != 0)
+            n = (long) (nl - src) + 1;
+        (void) memcpy(buf, src, (size_t) n);
+        dp->mark += n;
+        bp = buf + n;
+    } else
+#endif
     for (i = 0, bp = buf; i < len && dp->mark < dp->size && c != '\n';
          i++, bp++) {
         if (dlb_fread(bp, 1, 1, dp) <= 0)
@@ -423,6 +492,20 @@ dlb *dp;
     return dp->mark;
 }
 
+#ifdef DLBMMAP
+/* Are all the libraries mapped, with no stdio stream to read them by? */
+STATIC_OVL boolean
+lib_dlb_mapped(VOID_ARGS)
+{
+    int i;
+
+    for (i = 0; i < MAX_LIBS && dlb_libs[i].fdata; i++)
+        if (!dlb_libs[i].mdata)
+            return FALSE;
+    return TRUE;
+}
+#endif
+
 const dlb_procs_t lib_dlb_procs = { lib_dlb_init,  lib_dlb_cleanup,
                                     lib_dlb_fopen, lib_dlb_fclose,
                                     lib_dlb_fread, lib_dlb_fseek,
@@ -482,6 +565,39 @@ dlb_cleanup()
     }
 }
 
+/*
+ * For a process forked off one that had the libraries open.  Libraries
+ * read with stdio share their file offset with the parent, so they are
+ * opened anew; mapped ones can be read as they are.
+ */
+void
+dlb_unshare()
+{
+#ifdef DLBMMAP
+    if (dlb_initialized && dlb_procs == &lib_dlb_procs && lib_dlb_mapped())
+        return;
+#endif
+    dlb_cleanup();
+    (void) dlb_init();
+}
+
+/* Calls fn with the name of each file in the libraries. */
+void
+dlb_foreach(fn)
+void FDECL((*fn), (const char *));
+{
+#ifdef DLBLIB
+    int i;
+    long j;
+
+    if (!dlb_initialized || dlb_procs != &lib_dlb_procs)
+        return;
+    for (i = 0; i < MAX_LIBS && dlb_libs[i].fdata; i++)
+        for (j = 0; j < dlb_libs[i].nentries; j++)
+            (*fn)(dlb_libs[i].dir[j].fname);
+#endif
+}
+
 dlb *
 dlb_fopen(name, mode)
 const char *name, *mode;
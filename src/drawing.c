@@ -22,6 +22,7 @@ struct symsetentry symset[NUM_GRAPHICS];
 int currentgraphics = 0;
 
 nhsym showsyms[SYM_MAX] = DUMMY; /* symbols to be displayed */
+boolean showsyms_changed = TRUE; /* set whenever showsyms[] is */
 nhsym primary_syms[SYM_MAX] = DUMMY;   /* primary symbols          */
 nhsym rogue_syms[SYM_MAX] = DUMMY;   /* rogue symbols           */
 nhsym ov_primary_syms[SYM_MAX] = DUMMY;   /* overides via config SYMBOL */
@@ -378,6 +379,7 @@ init_showsyms()
         showsyms[i + SYM_OFF_W] = def_warnsyms[i].sym;
     for (i = 0; i < MAXOTHER; i++)
         showsyms[i + SYM_OFF_X] = get_othersym(i, PRIMARY);
+    showsyms_changed = TRUE;
 }
 
 /* initialize defaults for the overrides to the rogue symset */
@@ -509,6 +511,7 @@ int whichset;
         currentgraphics = PRIMARY;
         break;
     }
+    showsyms_changed = TRUE;
 }
 
 void
@@ -521,6 +524,7 @@ int nondefault;
         for (i = 0; i < SYM_MAX; i++)
             showsyms[i] = ov_primary_syms[i] ? ov_primary_syms[i]
                                              : primary_syms[i];
+        showsyms_changed = TRUE;
 #ifdef PC9800
         if (SYMHANDLING(H_IBM) && ibmgraphics_mode_callback)
             (*ibmgraphics_mode_callback)();
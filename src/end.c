@@ -65,8 +65,8 @@ STATIC_DCL void NDECL(dump_plines);
 STATIC_DCL void FDECL(dump_everything, (int, time_t));
 STATIC_DCL int NDECL(num_extinct);
 
-#if defined(__BEOS__) || defined(MICRO) || defined(OS2)
-extern void FDECL(nethack_exit, (int));
+#if defined(__BEOS__) || defined(MICRO) || defined(OS2) || defined(NLE_LIB)
+extern void FDECL(nethack_exit, (int)) NORETURN;
 #else
 #define nethack_exit exit
 #endif
@@ -1612,8 +1612,9 @@ int how;
 
     dump_close_log();
     /* "So when I die, the first thing I will see in Heaven is a
-     * score list?" */
-    if (have_windows && !iflags.toptenwin)
+     * score list?"  NLE: there is none when diskless, and the window
+     * port's last message is to carry the xlogfile entry */
+    if (have_windows && !iflags.toptenwin && !iflags.diskless)
         exit_nhwindows((char *) 0), have_windows = FALSE;
     topten(how, endtime);
     if (have_windows)
@@ -1731,6 +1732,9 @@ int status;
         return;
 #endif
     program_state.exiting = 1;
+#if defined(UNIX) && !defined(NLE_LIB)
+    nle_reuse_next(status); /* returns unless on to another game */
+#endif
     nethack_exit(status);
 }
 
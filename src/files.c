@@ -476,6 +476,56 @@ set_lock_and_bones()
 }
 #endif /* MFLOPPY */
 
+#ifdef UNIX
+/*
+ * NLE: with LEVELS_IN_MEMORY (see unixconf.h), levels other than level 0,
+ * the lock file, are kept in memory rather than in files; if
+ * iflags.diskless is set, all of them are, the lock file too (which
+ * leaves it empty, as getlock() isn't called then).  create_levelfile()
+ * and open_levelfile() return LEVELFD(lev) for those, which no file has:
+ * bufon() writes to it through levelfile_stream(), mread() reads it
+ * through nhread() and nhclose() leaves it be.  Games forked off get the
+ * levels along with the rest of their memory.
+ */
+#define LEVELFD_BASE 0x40000000 /* above any fd the kernel hands out */
+#define LEVELFD(lev) (LEVELFD_BASE + (lev))
+#define IS_LEVELFD(fd) ((fd) >= LEVELFD_BASE && (fd) < LEVELFD(MAXLINFO))
+#ifdef LEVELS_IN_MEMORY
+#define LEVEL_IN_MEMORY(lev) ((lev) || iflags.diskless)
+#else
+#define LEVEL_IN_MEMORY(lev) (iflags.diskless)
+#endif
+
+static struct levelmem {
+    char *data;
+    size_t size;
+    size_t pos; /* of the next nhread() */
+} levelmem[MAXLINFO];
+
+STATIC_OVL void
+free_levelmem(lev)
+int lev;
+{
+    free((genericptr_t) levelmem[lev].data);
+    levelmem[lev].data = (char *) 0;
+    levelmem[lev].size = levelmem[lev].pos = 0;
+}
+
+/* The stream for bufon() to write level fd to, null if fd is a file. */
+FILE *
+levelfile_stream(fd)
+int fd;
+{
+    struct levelmem *lm;
+
+    if (!IS_LEVELFD(fd))
+        return (FILE *) 0;
+    lm = &levelmem[fd - LEVELFD_BASE];
+    free_levelmem(fd - LEVELFD_BASE);
+    return open_memstream(&lm->data, &lm->size);
+}
+#endif /* UNIX */
+
 /* Construct a file name for a level-type file, which is of the form
  * something.level (with any old level stripped off).
  * This assumes there is space on the end of 'file' to append
@@ -512,6 +562,13 @@ char errbuf[];
     set_levelfile_name(lock, lev);
     fq_lock = fqname(lock, LEVELPREFIX, 0);
 
+#ifdef UNIX
+    if (LEVEL_IN_MEMORY(lev)) {
+        free_levelmem(lev);
+        level_info[lev].flags |= LFILE_EXISTS;
+        return LEVELFD(lev);
+    }
+#endif
 #if defined(MICRO) || defined(WIN32)
 /* Use O_TRUNC to force the file to be shortened if it already
  * exists and is currently longer.
@@ -557,6 +614,16 @@ char errbuf[];
     if (level_info[lev].where != ACTIVE)
         swapin_file(lev);
 #endif
+#ifdef UNIX
+    if (LEVEL_IN_MEMORY(lev)) {
+        fd = -1;
+        errno = ENOENT;
+        if (level_info[lev].flags & LFILE_EXISTS) {
+            levelmem[lev].pos = 0;
+            fd = LEVELFD(lev);
+        }
+    } else
+#endif
 #ifdef MAC
     fd = macopen(fq_lock, O_RDONLY | O_BINARY, LEVL_TYPE);
 #else
@@ -592,7 +659,12 @@ int lev;
         if (lev == 0)
             really_close();
 #endif
-        (void) unlink(fqname(lock, LEVELPREFIX, 0));
+#ifdef UNIX
+        if (LEVEL_IN_MEMORY(lev))
+            free_levelmem(lev);
+        else
+#endif
+            (void) unlink(fqname(lock, LEVELPREFIX, 0));
         level_info[lev].flags &= ~LFILE_EXISTS;
     }
 }
@@ -712,10 +784,36 @@ int
 nhclose(fd)
 int fd;
 {
+#ifdef UNIX
+    if (IS_LEVELFD(fd))
+        return 0;
+#endif
     return close(fd);
 }
 #endif /* ?HOLD_LOCKFILE_OPEN */
 
+/* read(), which also reads levels kept in memory */
+int
+nhread(fd, buf, len)
+int fd;
+genericptr_t buf;
+unsigned len;
+{
+#ifdef UNIX
+    if (IS_LEVELFD(fd)) {
+        struct levelmem *lm = &levelmem[fd - LEVELFD_BASE];
+
+        if (len > lm->size - lm->pos)
+            len = (unsigned) (lm->size - lm->pos);
+        if (len)
+            (void) memcpy(buf, (genericptr_t) (lm->data + lm->pos), len);
+        lm->pos += len;
+        return (int) len;
+    }
+#endif
+    return (int) read(fd, buf, len);
+}
+
 /* ----------  END LEVEL FILE HANDLING ----------- */
 
 /* ----------  BEGIN BONES FILE HANDLING ----------- */
@@ -57,6 +57,26 @@ static const int explcolors[] = {
 #define is_objpile(x,y) (!Hallucination && level.objects[(x)][(y)] \
                          && level.objects[(x)][(y)]->nexthere)
 
+/*
+ * What mapglyph() makes of each glyph with MG_FLAG_NOPOS, for
+ * map_glyphcell() and map_glyphcells().  That only depends on showsyms[]
+ * and on the few flags in glyphmap_key(); code that changes showsyms[]
+ * sets showsyms_changed.  The hero's spot still goes through mapglyph(),
+ * and objects that might be piled up are checked for a pile.
+ */
+struct glyphmap_entry {
+    nhsym sym;
+    uchar color;
+    uchar special;
+    boolean pile; /* MG_OBJPILE if more objects are here */
+};
+
+static struct glyphmap_entry glyphmap[MAX_GLYPH];
+static int glyphmap_flags = -1; /* glyphmap_key() it was built for */
+
+STATIC_DCL int NDECL(glyphmap_key);
+STATIC_DCL void NDECL(check_glyphmap);
+
 /*ARGSUSED*/
 int
 mapglyph(glyph, ochar, ocolor, ospecial, x, y, mgflags)
@@ -70,8 +90,9 @@ unsigned mgflags;
     nhsym ch;
     unsigned special = 0;
     /* condense multiple tests in macro version down to single */
-    boolean has_rogue_ibm_graphics = HAS_ROGUE_IBM_GRAPHICS,
-            is_you = (x == u.ux && y == u.uy),
+    boolean positioned = !(mgflags & MG_FLAG_NOPOS),
+            has_rogue_ibm_graphics = HAS_ROGUE_IBM_GRAPHICS,
+            is_you = (positioned && x == u.ux && y == u.uy),
             has_rogue_color = (has_rogue_ibm_graphics
                                && symset[currentgraphics].nocolor == 0);
 
@@ -88,7 +109,7 @@ unsigned mgflags;
         else
             obj_color(STATUE);
         special |= MG_STATUE;
-        if (is_objpile(x,y))
+        if (positioned && is_objpile(x,y))
             special |= MG_OBJPILE;
     } else if ((offset = (glyph - GLYPH_WARNING_OFF)) >= 0) { /* warn flash */
         idx = offset + SYM_OFF_W;
@@ -161,7 +182,7 @@ unsigned mgflags;
             }
         } else
             obj_color(offset);
-        if (offset != BOULDER && is_objpile(x,y))
+        if (offset != BOULDER && positioned && is_objpile(x,y))
             special |= MG_OBJPILE;
     } else if ((offset = (glyph - GLYPH_RIDDEN_OFF)) >= 0) { /* mon ridden */
         idx = mons[offset].mlet + SYM_OFF_M;
@@ -180,7 +201,7 @@ unsigned mgflags;
         else
             mon_color(offset);
         special |= MG_CORPSE;
-        if (is_objpile(x,y))
+        if (positioned && is_objpile(x,y))
             special |= MG_OBJPILE;
     } else if ((offset = (glyph - GLYPH_DETECT_OFF)) >= 0) { /* mon detect */
         idx = mons[offset].mlet + SYM_OFF_M;
@@ -253,6 +274,130 @@ unsigned mgflags;
     return idx;
 }
 
+/* the flags besides showsyms[] that mapglyph() away from the hero
+   depends on */
+STATIC_OVL int
+glyphmap_key()
+{
+    return (iflags.use_color ? 0x01 : 0)
+           | (HAS_ROGUE_IBM_GRAPHICS ? 0x02 : 0)
+           | (symset[currentgraphics].nocolor ? 0x04 : 0)
+           | (Is_rogue_level(&u.uz) ? 0x08 : 0)
+           | (sysopt.accessibility == 1 ? 0x10 : 0);
+}
+
+STATIC_OVL void
+check_glyphmap()
+{
+    struct glyphmap_entry *gm;
+    int glyph, key = glyphmap_key(), ch, color;
+    unsigned special;
+
+    if (key == glyphmap_flags && !showsyms_changed)
+        return;
+    for (glyph = 0; glyph < MAX_GLYPH; ++glyph) {
+        gm = &glyphmap[glyph];
+        (void) mapglyph(glyph, &ch, &color, &special, 0, 0, MG_FLAG_NOPOS);
+        gm->sym = (nhsym) ch;
+        gm->color = (uchar) color;
+        gm->special = (uchar) special;
+        gm->pile = (glyph_is_object(glyph)
+                    && glyph != objnum_to_glyph(BOULDER));
+    }
+    glyphmap_flags = key;
+    showsyms_changed = FALSE;
+}
+
+/* mapglyph(glyph, ..., x, y, 0) by table lookup, for window ports that
+   map every glyph they're asked to print */
+void
+map_glyphcell(glyph, ochar, ocolor, ospecial, x, y)
+int glyph, *ochar, *ocolor;
+unsigned *ospecial;
+int x, y;
+{
+    const struct glyphmap_entry *gm;
+
+    if (glyph < 0 || glyph >= MAX_GLYPH || (x == u.ux && y == u.uy)) {
+        (void) mapglyph(glyph, ochar, ocolor, ospecial, x, y, 0);
+        return;
+    }
+    check_glyphmap();
+    gm = &glyphmap[glyph];
+    *ochar = (int) gm->sym;
+    *ocolor = (int) gm->color;
+    *ospecial = gm->special;
+    if (gm->pile && is_objpile(x, y))
+        *ospecial |= MG_OBJPILE;
+}
+
+/*
+ * map_glyphcell() for a whole map in one pass: glyphs[] has ROWNO rows of
+ * COLNO - 1 glyphs each, for x from 1, as the rl window port keeps them;
+ * chars[], colors[] and specials[] are filled in likewise.
+ */
+void
+map_glyphcells(glyphs, chars, colors, specials)
+const short *glyphs;
+uchar *chars, *colors, *specials;
+{
+    const struct glyphmap_entry *gm;
+    int x, y, i, glyph, ch, color;
+    unsigned special;
+
+    check_glyphmap();
+    for (y = 0, i = 0; y < ROWNO; ++y)
+        for (x = 1; x < COLNO; ++x, ++i) {
+            glyph = glyphs[i];
+            if (glyph < 0 || glyph >= MAX_GLYPH
+                || (x == u.ux && y == u.uy)) {
+                (void) mapglyph(glyph, &ch, &color, &special, x, y, 0);
+                chars[i] = (uchar) ch;
+                colors[i] = (uchar) color;
+                specials[i] = (uchar) special;
+                continue;
+            }
+            gm = &glyphmap[glyph];
+            chars[i] = (uchar) gm->sym;
+            colors[i] = gm->color;
+            specials[i] = gm->special;
+            if (gm->pile && is_objpile(x, y))
+                specials[i] |= MG_OBJPILE;
+        }
+}
+
+#ifdef EXTRA_SANITY_CHECKS
+/* how many glyphs map_glyphcell() maps differently from mapglyph() away
+   from the hero, with color on and with it off */
+int
+glyphmap_mismatches()
+{
+    int glyph, x, y, ch[2], color[2], pass, bad = 0;
+    unsigned special[2];
+    boolean use_color = iflags.use_color;
+
+    for (pass = 0; pass < 2; ++pass) {
+        iflags.use_color = !pass;
+        for (glyph = 0, x = 1, y = 0; glyph < MAX_GLYPH; ++glyph) {
+            /* walk the map so every spot gets some glyphs */
+            do {
+                if (++x == COLNO) {
+                    x = 1;
+                    y = (y + 1) % ROWNO;
+                }
+            } while (x == u.ux && y == u.uy);
+            map_glyphcell(glyph, &ch[0], &color[0], &special[0], x, y);
+            (void) mapglyph(glyph, &ch[1], &color[1], &special[1], x, y, 0);
+            if (ch[0] != ch[1] || color[0] != color[1]
+                || special[0] != special[1])
+                ++bad;
+        }
+    }
+    iflags.use_color = use_color;
+    return bad;
+}
+#endif /* EXTRA_SANITY_CHECKS */
+
 char *
 encglyph(glyph)
 int glyph;
@@ -0,0 +1,357 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+/* NetHack may be freely redistributed.  See license for details. */
+
+/*
+ * nle.c: NetHack as a library (libnethack.so); see nle.h.
+ *
+ * NetHack expects to own the main loop and pulls keys out of the window
+ * port whenever it wants one.  Here the game runs as a coroutine on a stack
+ * of its own: nle_getch() swaps back to the caller of nle_start() or
+ * nle_step(), which swaps in again with the next action.  It is all one
+ * thread, so stepping the game is a plain function call.
+ */
+
+#ifdef __APPLE__
+/* the ucontext functions are only declared for XSI */
+#define _XOPEN_SOURCE 600
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include "hack.h"
+
+#include "nle.h"
+
+/* wintty.h points these at the functions below; we want the real ones */
+#undef putchar
+#undef puts
+#undef fputs
+#undef fflush
+
+#define NLE_STACK_SIZE (8 * 1024 * 1024) /* like a main thread */
+#define NLE_OUTBUF_SIZE 8192
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+struct nle_globals {
+    nle_obs *obs;
+    FILE *ttyrec;
+
+    char outbuf[NLE_OUTBUF_SIZE]; /* tty output since the last frame */
+    size_t outlen;
+
+    const void *message; /* Message flatbuffer built by winrl.cc */
+    size_t message_size;
+
+    boolean done;   /* nethack_exit() was called */
+    boolean ending; /* nle_end() before the game was over */
+
+    /* environment of the game, see nle_getenv() */
+    char *hackdir;
+    char *options;
+    char *playername;
+    char seeds[2][32];
+    boolean diskless;
+
+    ucontext_t caller; /* where nle_getch() and nethack_exit() return to */
+    ucontext_t game;   /* where nle_step() resumes NetHack */
+    void *stack;       /* the game's stack, with a guard page at the bottom */
+    size_t pagesize;
+};
+
+/* NetHack's state is global; so is the one game of this library copy. */
+static nle_ctx_t *nle = (nle_ctx_t *) 0;
+
+extern int FDECL(nhmain, (int, char **));
+
+static char *
+nle_strdup(const char *s)
+{
+    char *copy = (char *) alloc(strlen(s) + 1);
+
+    return strcpy(copy, s);
+}
+
+static void
+nle_put_le32(unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char) (v & 0xff);
+    p[1] = (unsigned char) ((v >> 8) & 0xff);
+    p[2] = (unsigned char) ((v >> 16) & 0xff);
+    p[3] = (unsigned char) ((v >> 24) & 0xff);
+}
+
+static void
+nle_write_frame(nle_ctx_t *ctx, const void *buf, size_t len, int channel)
+{
+    struct timeval tv;
+    unsigned char header[13];
+
+    if (!ctx->ttyrec)
+        return;
+
+    /* ttyrec2: little-endian sec, usec, len, then one byte of channel */
+    gettimeofday(&tv, (struct timezone *) 0);
+    nle_put_le32(&header[0], (unsigned long) tv.tv_sec);
+    nle_put_le32(&header[4], (unsigned long) tv.tv_usec);
+    nle_put_le32(&header[8], (unsigned long) len);
+    header[12] = (unsigned char) channel;
+
+    fwrite(header, 1, sizeof header, ctx->ttyrec);
+    fwrite(buf, 1, len, ctx->ttyrec);
+}
+
+static void
+nle_flush_output(nle_ctx_t *ctx)
+{
+    if (!ctx->outlen)
+        return;
+    nle_write_frame(ctx, ctx->outbuf, ctx->outlen, 0);
+    ctx->outlen = 0;
+}
+
+static void
+nle_out(int c)
+{
+    if (nle->outlen == NLE_OUTBUF_SIZE)
+        nle_flush_output(nle);
+    nle->outbuf[nle->outlen++] = (char) c;
+}
+
+int
+nle_putchar(int c)
+{
+    if (c == '\n') /* the pty used to do this for us */
+        nle_out('\r');
+    nle_out(c);
+    return c;
+}
+
+int
+nle_puts(const char *s)
+{
+    while (*s)
+        nle_putchar(*s++);
+    return nle_putchar('\n');
+}
+
+int
+nle_fputs(const char *s, FILE *stream)
+{
+    if (stream != stdout)
+        return fputs(s, stream);
+    if (!s) /* termcap.c's xputs() of a missing capability, cf. tputs() */
+        return EOF;
+    while (*s)
+        nle_putchar(*s++);
+    return 0;
+}
+
+int
+nle_fflush(FILE *stream)
+{
+    /* output is framed once per step, see nle_getch() */
+    if (stream != stdout)
+        return fflush(stream);
+    return 0;
+}
+
+/* nh_getenv_hook: the environment the process backend would exec with. */
+static char *
+nle_getenv(const char *name)
+{
+    if (!strcmp(name, "HACKDIR"))
+        return nle->hackdir;
+    if (!strcmp(name, "NETHACKOPTIONS"))
+        return nle->options;
+    if (!strcmp(name, "USER"))
+        return nle->playername;
+    if (!strcmp(name, "NLE_SEED_CORE") && *nle->seeds[0])
+        return nle->seeds[0];
+    if (!strcmp(name, "NLE_SEED_DISP") && *nle->seeds[1])
+        return nle->seeds[1];
+    if (!strcmp(name, "NLE_DISKLESS") && nle->diskless)
+        return "1";
+    return (char *) 0;
+}
+
+/* Entry point of the game's context; makecontext() can't pass pointers. */
+static void
+nle_game_main(void)
+{
+    char *argv[3];
+
+    argv[0] = "nethack";
+    argv[1] = "-u";
+    argv[2] = nle->playername;
+
+    nhmain(3, argv); /* doesn't return, see nethack_exit() */
+}
+
+/* Called from the tty window port whenever NetHack wants a key. */
+int
+nle_getch(void)
+{
+    nle_flush_output(nle);
+    swapcontext(&nle->game, &nle->caller);
+
+    if (nle->ending) {
+        /* like a hangup, minus the save */
+        exit_nhwindows((char *) 0);
+        clearlocks();
+        nh_terminate(EXIT_SUCCESS);
+    }
+    return nle->obs->action;
+}
+
+nle_obs *
+nle_get_obs(void)
+{
+    return nle->obs;
+}
+
+void
+nle_set_message(const void *buf, size_t size)
+{
+    nle->message = buf;
+    nle->message_size = size;
+}
+
+const void *
+nle_get_message(nle_ctx_t *ctx, size_t *size)
+{
+    *size = ctx->message_size;
+    return ctx->message;
+}
+
+#ifdef EXTRA_SANITY_CHECKS
+/* For the tests; see glyphmap_mismatches(). */
+int
+nle_check_glyphmap(nle_ctx_t *ctx)
+{
+    nhUse(ctx);
+    return glyphmap_mismatches();
+}
+#endif
+
+/* end.c and error() end up here instead of in exit().  The game's stack is
+ * abandoned as it is; nle_end() unmaps it. */
+void
+nethack_exit(int status)
+{
+    nhUse(status);
+    nle->done = TRUE;
+    nle->obs->done = 1;
+    nle_flush_output(nle);
+    setcontext(&nle->caller);
+}
+
+nle_ctx_t *
+nle_start(nle_settings *settings, nle_obs *obs, FILE *ttyrec)
+{
+    nle_ctx_t *ctx;
+    char *stack;
+    int i;
+
+    if (nle) /* one game per copy of the library */
+        return (nle_ctx_t *) 0;
+
+    ctx = (nle_ctx_t *) alloc(sizeof(nle_ctx_t));
+    memset(ctx, 0, sizeof(nle_ctx_t));
+    ctx->obs = obs;
+    ctx->ttyrec = ttyrec;
+    ctx->hackdir = nle_strdup(settings->hackdir);
+    ctx->options = nle_strdup(settings->options);
+    ctx->playername = nle_strdup(settings->playername);
+    for (i = 0; i < 2; ++i)
+        if (settings->seeds[i])
+            Sprintf(ctx->seeds[i], "%lu", settings->seeds[i]);
+    ctx->diskless = settings->diskless != 0;
+
+    memset(obs, 0, sizeof(nle_obs));
+
+    ctx->pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    stack = mmap((void *) 0, NLE_STACK_SIZE + ctx->pagesize,
+                 PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED || getcontext(&ctx->game)) {
+        if (stack != MAP_FAILED)
+            munmap(stack, NLE_STACK_SIZE + ctx->pagesize);
+        nle_end(ctx);
+        return (nle_ctx_t *) 0;
+    }
+    /* stacks grow down on everything we run on; overflowing should crash */
+    mprotect(stack, ctx->pagesize, PROT_NONE);
+    ctx->stack = stack;
+
+    ctx->game.uc_stack.ss_sp = stack + ctx->pagesize;
+    ctx->game.uc_stack.ss_size = NLE_STACK_SIZE;
+    ctx->game.uc_link = &ctx->caller;
+    makecontext(&ctx->game, nle_game_main, 0);
+
+    nle = ctx;
+    nh_getenv_hook = nle_getenv;
+
+    /* run up to the first nle_getch() */
+    swapcontext(&ctx->caller, &ctx->game);
+    return ctx;
+}
+
+nle_ctx_t *
+nle_step(nle_ctx_t *ctx, nle_obs *obs)
+{
+    unsigned char key;
+
+    if (ctx->done)
+        return ctx;
+
+    ctx->obs = obs;
+    key = (unsigned char) obs->action;
+    nle_write_frame(ctx, &key, 1, 1);
+    swapcontext(&ctx->caller, &ctx->game);
+    return ctx;
+}
+
+void
+nle_end(nle_ctx_t *ctx)
+{
+#ifdef PREFIXES_IN_USE
+    int i;
+#endif
+
+    if (nle == ctx) {
+        if (!ctx->done) {
+            ctx->ending = TRUE;
+            swapcontext(&ctx->caller, &ctx->game);
+        }
+        nle = (nle_ctx_t *) 0;
+        nh_getenv_hook = 0;
+        nle_rl_free();
+
+#ifdef PREFIXES_IN_USE
+        /* allocated by chdirx() */
+        for (i = 0; i < PREFIX_COUNT; i++)
+            if (fqn_prefix[i]) {
+                free((genericptr_t) fqn_prefix[i]);
+                fqn_prefix[i] = (char *) 0;
+            }
+#endif
+    }
+
+    if (ctx->ttyrec)
+        fflush(ctx->ttyrec);
+    if (ctx->stack)
+        munmap(ctx->stack, NLE_STACK_SIZE + ctx->pagesize);
+    free((genericptr_t) ctx->hackdir);
+    free((genericptr_t) ctx->options);
+    free((genericptr_t) ctx->playername);
+    free((genericptr_t) ctx);
+}
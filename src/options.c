@@ -649,11 +649,16 @@ boolean val_allowed;
  * if it's put in a smaller buffer, the responsible code will have to
  * bounds-check itself.
  */
+
+/* NLE: lets a program running NetHack in-process supply the environment
+   of the game instead of the process-wide one (see nle.c) */
+char *FDECL((*nh_getenv_hook), (const char *)) = 0;
+
 char *
 nh_getenv(ev)
 const char *ev;
 {
-    char *getev = getenv(ev);
+    char *getev = nh_getenv_hook ? (*nh_getenv_hook)(ev) : getenv(ev);
 
     if (getev && strlen(getev) <= (BUFSZ / 2))
         return getev;
@@ -842,10 +847,16 @@ initoptions_finish()
 {
     nhsym sym = 0;
 #ifndef MAC
-    char *opts = getenv("NETHACKOPTIONS");
+    char *opts;
 
-    if (!opts)
-        opts = getenv("HACKOPTIONS");
+    /* not nh_getenv(); the options string may legitimately be long */
+    if (nh_getenv_hook) {
+        opts = (*nh_getenv_hook)("NETHACKOPTIONS");
+    } else {
+        opts = getenv("NETHACKOPTIONS");
+        if (!opts)
+            opts = getenv("HACKOPTIONS");
+    }
     if (opts) {
         if (*opts == '/' || *opts == '\\' || *opts == '@') {
             if (*opts == '@')
@@ -886,8 +897,10 @@ initoptions_finish()
 
     sym = get_othersym(SYM_BOULDER,
                 Is_rogue_level(&u.uz) ? ROGUESET : PRIMARY);
-    if (sym)
+    if (sym) {
         showsyms[SYM_BOULDER + SYM_OFF_X] = sym;
+        showsyms_changed = TRUE;
+    }
     reglyph_darkroom();
 
 #ifdef STATUS_HILITES
@@ -2784,8 +2797,10 @@ boolean tinitial, tfrom_file;
             if (!initial) {
                 nhsym sym = get_othersym(SYM_BOULDER,
                                 Is_rogue_level(&u.uz) ? ROGUESET : PRIMARY);
-                if (sym)
+                if (sym) {
                     showsyms[SYM_BOULDER + SYM_OFF_X] = sym;
+                    showsyms_changed = TRUE;
+                }
                 need_redraw = TRUE;
             }
         }
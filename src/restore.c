@@ -686,6 +686,9 @@ unsigned int *stuckid, *steedid;
     restlevchn(fd);
     mread(fd, (genericptr_t) &moves, sizeof moves);
     mread(fd, (genericptr_t) &monstermoves, sizeof monstermoves);
+#ifdef USE_ISAAC64
+    rest_rngs(fd);
+#endif
     mread(fd, (genericptr_t) &quest_status, sizeof (struct q_score));
     mread(fd, (genericptr_t) spl_book, (MAXSPELL + 1) * sizeof (struct spell));
     restore_artifacts(fd);
@@ -1632,7 +1635,7 @@ register unsigned int len;
 #define readLenType unsigned
 #endif
 
-    rlen = read(fd, buf, (readLenType) len);
+    rlen = nhread(fd, buf, len);
     if ((readLenType) rlen != (readLenType) len) {
         if (restoreprocs.mread_flags == 1) { /* means "return anyway" */
             restoreprocs.mread_flags = -1;
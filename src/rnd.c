@@ -19,6 +19,8 @@ struct rnglist_t {
 
 enum { CORE = 0, DISP = 1 };
 
+extern unsigned long nle_seeds[]; /* hacklib.c */
+
 static struct rnglist_t rnglist[] = {
     { rn2, FALSE, { 0 } },                      /* CORE */
     { rn2_on_display_rng, FALSE, { 0 } },       /* DISP */
@@ -56,6 +58,33 @@ int FDECL((*fn), (int));
                  (int) sizeof seed);
 }
 
+/* NLE: the RNGs go into save files, see savegamestate(). */
+void
+save_rngs(fd)
+int fd;
+{
+    int i;
+
+    for (i = 0; i < SIZE(rnglist); ++i)
+        bwrite(fd, (genericptr_t) &rnglist[i].rng_state,
+               sizeof rnglist[i].rng_state);
+    bwrite(fd, (genericptr_t) nle_seeds, SIZE(rnglist) * sizeof *nle_seeds);
+}
+
+void
+rest_rngs(fd)
+int fd;
+{
+    int i;
+
+    for (i = 0; i < SIZE(rnglist); ++i) {
+        mread(fd, (genericptr_t) &rnglist[i].rng_state,
+              sizeof rnglist[i].rng_state);
+        rnglist[i].init = TRUE;
+    }
+    mread(fd, (genericptr_t) nle_seeds, SIZE(rnglist) * sizeof *nle_seeds);
+}
+
 static int
 RND(int x)
 {
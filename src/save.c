@@ -74,6 +74,9 @@ static struct save_procs {
 /* need to preserve these during save to avoid accessing freed memory */
 static unsigned ustuck_id = 0, usteed_id = 0;
 
+/* NLE: savesnapshot() is writing; the game goes on afterwards */
+static boolean snapshotting = FALSE;
+
 int
 dosave()
 {
@@ -275,6 +278,71 @@ dosave0()
     return 1;
 }
 
+/* NLE: writes the game to fd in save file format, as dosave0() would, but
+ * leaves it running as if it hadn't been saved: what saving changes in the
+ * game is put back afterwards, or left alone while snapshotting.  The other
+ * levels are copied from their level files, which hold just what savelev()
+ * wrote.  Returns 0 without touching fd if there is no game to save yet, 1
+ * after writing and closing fd.
+ */
+int
+savesnapshot(fd)
+int fd;
+{
+    char buf[BUFSIZ], whynot[BUFSZ];
+    struct u_realtime realtime;
+    schar luck;
+    xchar ltmp;
+    int ofd;
+    ssize_t n;
+
+    if (!program_state.something_worth_saving)
+        return 0;
+
+    /* savegamestate() starts timing anew; change_luck() may clip */
+    realtime = urealtime;
+    luck = u.uluck;
+
+    /* as in dosave0(); moveloop() redoes these for the restored game */
+    if (flags.moonphase == FULL_MOON)
+        change_luck(-1);
+    if (flags.friday13)
+        change_luck(1);
+
+    store_version(fd);
+    store_savefileinfo(fd);
+    store_plname_in_file(fd);
+    ustuck_id = (u.ustuck ? u.ustuck->m_id : 0);
+    usteed_id = (u.usteed ? u.usteed->m_id : 0);
+    snapshotting = TRUE;
+    savelev(fd, ledger_no(&u.uz), WRITE_SAVE);
+    savegamestate(fd, WRITE_SAVE);
+    snapshotting = FALSE;
+
+    urealtime = realtime;
+    u.uluck = luck;
+
+    for (ltmp = (xchar) 1; ltmp <= maxledgerno(); ltmp++) {
+        if (ltmp == ledger_no(&u.uz))
+            continue;
+        if (!(level_info[ltmp].flags & LFILE_EXISTS))
+            continue;
+        ofd = open_levelfile(ltmp, whynot);
+        if (ofd < 0) {
+            impossible("%s", whynot);
+            continue;
+        }
+        bwrite(fd, (genericptr_t) &ltmp, sizeof ltmp); /* level number*/
+        bflush(fd);
+        while ((n = nhread(ofd, buf, sizeof buf)) > 0)
+            if (write(fd, buf, n) != n)
+                panic("cannot write %ld bytes to file #%d", (long) n, fd);
+        (void) nhclose(ofd);
+    }
+    bclose(fd);
+    return 1;
+}
+
 STATIC_OVL void
 savegamestate(fd, mode)
 register int fd, mode;
@@ -335,6 +403,9 @@ register int fd, mode;
     savelevchn(fd, mode);
     bwrite(fd, (genericptr_t) &moves, sizeof moves);
     bwrite(fd, (genericptr_t) &monstermoves, sizeof monstermoves);
+#ifdef USE_ISAAC64
+    save_rngs(fd); /* NLE: restored games draw the same numbers */
+#endif
     bwrite(fd, (genericptr_t) &quest_status, sizeof quest_status);
     bwrite(fd, (genericptr_t) spl_book,
            sizeof(struct spell) * (MAXSPELL + 1));
@@ -387,6 +458,8 @@ savestateinlock()
      * noop pid rewriting will take place on the first "checkpoint" after
      * the game is started or restored, if checkpointing is off.
      */
+    if (iflags.diskless)
+        return; /* NLE: no lock file to recover the game from */
     if (flags.ins_chkpt || havestate) {
         /* save the rest of the current game state in the lock file,
          * following the original int pid, the current level number,
@@ -503,8 +576,8 @@ int mode;
            a panic save rather than a normal one, or sometimes
            when changing levels without taking time -- e.g.
            create statue trap then immediately level teleport) */
-        if (iflags.purge_monsters)
-            dmonsfree();
+        if (iflags.purge_monsters && !snapshotting)
+            dmonsfree(); /* snapshots skip them, see savemonchn() */
 
         if (fd < 0)
             panic("Save on bad file!"); /* impossible */
@@ -690,7 +763,8 @@ int fd;
         if (bw_fd >= 0)
             panic("double buffering unexpected");
         bw_fd = fd;
-        if ((bw_FILE = fdopen(fd, "w")) == 0)
+        if ((bw_FILE = levelfile_stream(fd)) == 0
+            && (bw_FILE = fdopen(fd, "w")) == 0)
             panic("buffering of file %d failed", fd);
     }
 #endif
@@ -1129,9 +1203,14 @@ register struct monst *mtmp;
 
     while (mtmp) {
         mtmp2 = mtmp->nmon;
+        if (snapshotting && DEADMONSTER(mtmp) && !mtmp->isgd) {
+            /* what dmonsfree() would have freed; it's the game's to free */
+            mtmp = mtmp2;
+            continue;
+        }
         if (perform_bwrite(mode)) {
             mtmp->mnum = monsndx(mtmp->data);
-            if (mtmp->ispriest)
+            if (mtmp->ispriest && !snapshotting)
                 forget_temple_entry(mtmp); /* EPRI() */
             savemon(fd, mtmp);
         }
@@ -166,6 +166,8 @@ STATIC_DCL long FDECL(opvar_array_length, (struct sp_coder *));
 #endif /*0*/
 STATIC_DCL void FDECL(spo_shuffle_array, (struct sp_coder *));
 STATIC_DCL boolean FDECL(sp_level_coder, (sp_lev *));
+STATIC_DCL sp_lev *FDECL(cached_special, (const char *));
+STATIC_DCL void FDECL(preload_special_file, (const char *));
 
 #define LEFT 1
 #define H_LEFT 2
@@ -6020,36 +6022,96 @@ sp_lev *lvl;
 }
 
 /*
- * General loader
+ * Special levels, loaded.  sp_level_coder() only reads the opcodes, so
+ * each level file is loaded once per process and kept until it exits;
+ * a zygote loads them all before forking games off, see preload_special().
+ * The in-process library carries sp_lev_cache over from one game to the
+ * next and has it freed with free_special_levels(), see nledl.c.
  */
-boolean
-load_special(name)
+struct sp_lev_cache {
+    struct sp_lev_cache *next;
+    char *name;
+    sp_lev lvl;
+};
+
+struct sp_lev_cache *sp_lev_cache = 0;
+
+STATIC_OVL sp_lev *
+cached_special(name)
 const char *name;
 {
+    struct sp_lev_cache *slc;
     dlb *fd;
-    sp_lev *lvl = NULL;
-    boolean result = FALSE;
     struct version_info vers_info;
 
+    for (slc = sp_lev_cache; slc; slc = slc->next)
+        if (!strcmp(slc->name, name))
+            return &slc->lvl;
+
     fd = dlb_fopen(name, RDBMODE);
     if (!fd)
-        return FALSE;
+        return (sp_lev *) 0;
     Fread((genericptr_t) &vers_info, sizeof vers_info, 1, fd);
     if (!check_version(&vers_info, name, TRUE)) {
         (void) dlb_fclose(fd);
-        goto give_up;
+        return (sp_lev *) 0;
     }
 
-    lvl = (sp_lev *) alloc(sizeof (sp_lev));
-    result = sp_level_loader(fd, lvl);
+    slc = New(struct sp_lev_cache);
+    slc->name = dupstr(name);
+    if (!sp_level_loader(fd, &slc->lvl)) {
+        (void) dlb_fclose(fd);
+        (void) sp_level_free(&slc->lvl);
+        Free(slc->name);
+        Free(slc);
+        return (sp_lev *) 0;
+    }
     (void) dlb_fclose(fd);
-    if (result)
-        result = sp_level_coder(lvl);
-    sp_level_free(lvl);
-    Free(lvl);
+    slc->next = sp_lev_cache;
+    sp_lev_cache = slc;
+    return &slc->lvl;
+}
+
+STATIC_OVL void
+preload_special_file(name)
+const char *name;
+{
+    int len = (int) strlen(name) - (int) strlen(LEV_EXT);
+
+    if (len > 0 && !strcmp(name + len, LEV_EXT))
+        (void) cached_special(name);
+}
+
+/* Loads every special level in the data libraries. */
+void
+preload_special()
+{
+    dlb_foreach(preload_special_file);
+}
+
+void
+free_special_levels()
+{
+    struct sp_lev_cache *slc;
+
+    while ((slc = sp_lev_cache) != 0) {
+        sp_lev_cache = slc->next;
+        sp_level_free(&slc->lvl);
+        Free(slc->name);
+        Free(slc);
+    }
+}
+
+/*
+ * General loader
+ */
+boolean
+load_special(name)
+const char *name;
+{
+    sp_lev *lvl = cached_special(name);
 
-give_up:
-    return result;
+    return lvl ? sp_level_coder(lvl) : FALSE;
 }
 
 #ifdef _MSC_VER
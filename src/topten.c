@@ -84,6 +84,10 @@ STATIC_DCL void FDECL(nsb_unmung_line, (char *));
 
 static winid toptenwin = WIN_ERR;
 
+/* NLE: the xlogfile entry of a diskless game that ended, for winrl.cc;
+   always defined, but only filled in with XLOGFILE on UNIX */
+char nle_xlogentry[BUFSZ * 4] = DUMMY;
+
 /* "killed by",&c ["an"] 'killer.name' */
 void
 formatkiller(buf, siz, how, incl_helpless)
@@ -562,6 +566,20 @@ time_t when;
     t0->fpos = -1L;
 #endif
 
+    /* NLE: no files to write to and no record to show; the xlogfile entry
+       goes to the rl window port's final message instead, see done() */
+    if (iflags.diskless) {
+#if defined(XLOGFILE) && defined(UNIX)
+        xlfile = fmemopen(nle_xlogentry, sizeof nle_xlogentry - 1, "w");
+        if (xlfile) {
+            writexlentry(xlfile, t0, how);
+            (void) fclose(xlfile);
+            (void) strip_newline(nle_xlogentry);
+        }
+#endif
+        goto destroywin;
+    }
+
 #ifdef LOGFILE /* used for debugging (who dies of what, where) */
     if (lock_file(LOGFILE, SCOREPREFIX, 10)) {
         if (!(lfile = fopen_datafile(LOGFILE, "a", SCOREPREFIX))) {
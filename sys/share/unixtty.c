@@ -11,6 +11,9 @@
 
 #define NEED_VARARGS
 #include "hack.h"
+#ifdef NLE_LIB
+#include "nle.h"
+#endif
 
 /*
  * The distinctions here are not BSD - rest but rather USG - rest, as
@@ -203,6 +206,40 @@ setctty()
         perror("NetHack (setctty)");
 }
 
+#ifdef NLE_LIB
+/*
+ * The in-process library has no terminal of its own: stdin and stdout
+ * belong to the host program.  Pretend to be on a freshly opened pty.
+ */
+void
+gettty()
+{
+    erase_char = '\177'; /* ^? */
+    kill_char = 'U' & 037;
+    intr_char = 'C' & 037;
+    settty_needed = FALSE;
+}
+
+void
+settty(s)
+const char *s;
+{
+    end_screen();
+    if (s)
+        raw_print(s);
+    iflags.echo = ON;
+    iflags.cbreak = OFF;
+}
+
+void
+setftty()
+{
+    iflags.cbreak = ON;
+    iflags.echo = OFF;
+    start_screen();
+}
+#else /* !NLE_LIB */
+
 /*
  * Get initial state of terminal, set ospeed (for termcap routines)
  * and switch off tab expansion if necessary.
@@ -313,6 +350,7 @@ setftty()
         setctty();
     start_screen();
 }
+#endif /* ?NLE_LIB */
 
 void intron() /* enable kbd interupts if enabled when game started */
 {
@@ -480,6 +518,10 @@ VA_DECL(const char *, s)
     Vprintf(s, VA_ARGS);
     (void) putchar('\n');
     VA_END();
+#ifdef NLE_LIB
+    nethack_exit(EXIT_FAILURE); /* ends the game, not the host program */
+#else
     exit(EXIT_FAILURE);
+#endif
 }
 #endif /* !__begui__ */
@@ -0,0 +1,329 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+
+/*
+ * nlebench.c: latency benchmark of in-process games; see usage().
+ *
+ * Plays games through nledl.h with fixed seeds and fixed action traces, so
+ * that runs of the same build are comparable, and prints the p50/p99
+ * latency of each phase of a game as JSON:
+ *
+ *   spawn     nledl_start(), up to the first key NetHack asks for
+ *   moveloop  from nledl_start() until the game is in its moveloop
+ *   step      one step of a random walk
+ *   menu      opening the inventory menu
+ *   level     the step that digs through to the next level
+ *   gameover  from #quit until the game has ended
+ *
+ * Games are played as Archeologists, who start with a pick-axe to dig
+ * down with.  Samples missing from a game (say, it died first) are just
+ * left out; each phase reports how many it got.
+ *
+ * This is linked with nledl.c, not with NetHack: make nlebench in src.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nledl.h"
+
+#define NLEBENCH_ESC 033
+#define NLEBENCH_MORE '\r'
+#define NLEBENCH_PATIENCE 100 /* keys to give a phase before giving up */
+
+enum { SPAWN, MOVELOOP, STEP, MENU, LEVEL, GAMEOVER, NPHASES };
+
+static const char *phase_names[NPHASES] = { "spawn", "moveloop", "step",
+                                            "menu",  "level",    "gameover" };
+
+typedef struct {
+    double *us; /* samples, in microseconds */
+    size_t n, size;
+} samples;
+
+static samples phases[NPHASES];
+
+static const char *default_options =
+    "windowtype:rl,color,showexp,autopickup,pickup_types:$?!/,"
+    "pickup_burden:unencumbered";
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-g games] [-k steps] [-s seed] [-o options] "
+            "libnethack.so\n"
+            "Plays games with seeds seed, seed + 1, ... in the HACKDIR\n"
+            "of libnethack.so, without writing files, and prints the\n"
+            "latencies of their phases as JSON.\n",
+            argv0);
+    exit(EXIT_FAILURE);
+}
+
+static double
+now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void
+record(int phase, double us)
+{
+    samples *s = &phases[phase];
+
+    if (s->n == s->size) {
+        s->size = s->size ? 2 * s->size : 256;
+        if (!(s->us = (double *) realloc(s->us, s->size * sizeof *s->us))) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->us[s->n++] = us;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples. */
+static double
+percentile(const samples *s, double p)
+{
+    size_t rank = (size_t) (p / 100 * s->n + 0.5);
+
+    if (!s->n)
+        return 0;
+    return s->us[rank ? (rank > s->n ? s->n : rank) - 1 : 0];
+}
+
+/* xorshift64*, for action traces that don't depend on libc's rand(). */
+static unsigned long long
+trace_next(unsigned long long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static double
+step(nledl_ctx *ctx, nle_obs *obs, int key)
+{
+    double start = now_us();
+
+    obs->action = key;
+    nledl_step(ctx, obs);
+    return now_us() - start;
+}
+
+/* Dismisses --More-- and answers prompts with ESC until NetHack asks for
+   a command again. */
+static void
+settle(nledl_ctx *ctx, nle_obs *obs)
+{
+    int i;
+
+    for (i = 0; i < NLEBENCH_PATIENCE && !obs->done && obs->xwaitforspace;
+         ++i)
+        step(ctx, obs, NLEBENCH_MORE);
+}
+
+static int
+pickaxe_letter(const nle_obs *obs)
+{
+    int i;
+
+    for (i = 0; i < NLE_INVENTORY_SIZE && obs->inv_letters[i]; ++i)
+        if (strstr((const char *) obs->inv_strs[i], "pick-axe"))
+            return obs->inv_letters[i];
+    return 0;
+}
+
+static void
+dig_down(nledl_ctx *ctx, nle_obs *obs, unsigned long long *trace)
+{
+    static const char dirs[] = "kjhlyubn";
+    int depth = obs->blstats[NLE_BL_DEPTH], letter = pickaxe_letter(obs);
+    int i;
+    double us;
+
+    if (!letter)
+        return;
+    for (i = 0; i < NLEBENCH_PATIENCE / 4 && !obs->done; ++i) {
+        step(ctx, obs, 'a');
+        step(ctx, obs, letter);
+        us = step(ctx, obs, '>');
+        /* "You dig a hole through the floor.--More--" comes first */
+        while (!obs->done && obs->xwaitforspace
+               && obs->blstats[NLE_BL_DEPTH] == depth)
+            us += step(ctx, obs, NLEBENCH_MORE);
+        if (obs->blstats[NLE_BL_DEPTH] != depth) {
+            record(LEVEL, us);
+            break;
+        }
+        /* maybe on stairs or on an undiggable spot; move and retry */
+        step(ctx, obs, NLEBENCH_ESC);
+        step(ctx, obs, dirs[trace_next(trace) % 8]);
+        settle(ctx, obs);
+    }
+    settle(ctx, obs);
+}
+
+static void
+quit(nledl_ctx *ctx, nle_obs *obs)
+{
+    const char *keys = "#quit\ry";
+    double us = 0;
+    int i;
+
+    settle(ctx, obs);
+    for (; *keys && !obs->done; ++keys)
+        us += step(ctx, obs, *keys);
+    for (i = 0; i < NLEBENCH_PATIENCE && !obs->done; ++i)
+        us += step(ctx, obs, NLEBENCH_ESC);
+    if (obs->done)
+        record(GAMEOVER, us);
+}
+
+static int
+play(nledl_ctx *ctx, nle_settings *settings, nle_obs *obs, int steps)
+{
+    static const char dirs[] = "kjhlyubn";
+    unsigned long long trace = settings->seeds[0] * 2 + 1;
+    double start = now_us();
+    int i;
+
+    if (nledl_start(ctx, settings, obs, NULL)) {
+        fprintf(stderr, "nlebench: %s\n", nledl_error(ctx));
+        return -1;
+    }
+    record(SPAWN, now_us() - start);
+
+    for (i = 0; i < NLEBENCH_PATIENCE && !obs->done && !obs->in_moveloop;
+         ++i)
+        step(ctx, obs, obs->xwaitforspace ? NLEBENCH_MORE : NLEBENCH_ESC);
+    if (obs->in_moveloop)
+        record(MOVELOOP, now_us() - start);
+
+    for (i = 0; i < steps && !obs->done; ++i) {
+        if (obs->xwaitforspace) {
+            step(ctx, obs, NLEBENCH_MORE);
+            continue;
+        }
+        record(STEP, step(ctx, obs, dirs[trace_next(&trace) % 8]));
+    }
+
+    settle(ctx, obs);
+    if (!obs->done) {
+        record(MENU, step(ctx, obs, 'i'));
+        step(ctx, obs, NLEBENCH_ESC);
+        settle(ctx, obs);
+    }
+
+    if (!obs->done)
+        dig_down(ctx, obs, &trace);
+    if (!obs->done)
+        quit(ctx, obs);
+    nledl_end(ctx);
+    return 0;
+}
+
+static void
+print_json(const char *dlpath, int games, int steps, unsigned long seed)
+{
+    int i;
+
+    printf("{\n  \"harness\": \"nlebench\",\n");
+    printf("  \"library\": \"%s\",\n", dlpath);
+    printf("  \"games\": %d,\n  \"steps\": %d,\n  \"seed\": %lu,\n", games,
+           steps, seed);
+    printf("  \"phases\": {\n");
+    for (i = 0; i < NPHASES; ++i) {
+        samples *s = &phases[i];
+
+        qsort(s->us, s->n, sizeof *s->us, cmp_double);
+        printf("    \"%s\": {\"n\": %lu, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+               "\"max_us\": %.1f}%s\n",
+               phase_names[i], (unsigned long) s->n, percentile(s, 50),
+               percentile(s, 99), s->n ? s->us[s->n - 1] : 0.0,
+               i + 1 < NPHASES ? "," : "");
+    }
+    printf("  }\n}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    nle_settings settings;
+    nle_obs *obs;
+    nledl_ctx *ctx;
+    char *hackdir, *slash;
+    int games = 100, steps = 1000, c, i;
+    unsigned long seed = 1;
+
+    memset(&settings, 0, sizeof settings);
+    settings.options = default_options;
+    settings.playername = "Agent-arc-hum-neu-mal";
+    settings.diskless = 1;
+
+    while ((c = getopt(argc, argv, "g:k:s:o:")) != -1) {
+        switch (c) {
+        case 'g':
+            games = atoi(optarg);
+            break;
+        case 'k':
+            steps = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            settings.options = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind + 1 != argc || games <= 0 || steps < 0)
+        usage(argv[0]);
+
+    /* diskless games play in the installed HACKDIR */
+    if (!(hackdir = strdup(argv[optind]))) {
+        perror("strdup");
+        return EXIT_FAILURE;
+    }
+    if ((slash = strrchr(hackdir, '/')) != NULL)
+        *slash = '\0';
+    else
+        strcpy(hackdir, ".");
+    settings.hackdir = hackdir;
+
+    if (!(obs = (nle_obs *) calloc(1, sizeof *obs))
+        || !(ctx = nledl_open(argv[optind]))) {
+        perror("nlebench");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < games; ++i) {
+        settings.seeds[0] = settings.seeds[1] = seed + i;
+        if (play(ctx, &settings, obs, steps)) {
+            nledl_close(ctx);
+            return EXIT_FAILURE;
+        }
+    }
+    nledl_close(ctx);
+
+    print_json(argv[optind], games, steps, seed);
+    free(obs);
+    free(hackdir);
+    return EXIT_SUCCESS;
+}
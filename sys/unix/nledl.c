@@ -0,0 +1,308 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+
+/*
+ * nledl.c: runs games in private copies of libnethack.so; see nledl.h.
+ *
+ * This is linked into the program hosting the games, not into NetHack.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE /* for dl_iterate_phdr() */
+#endif
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef __ELF__
+#include <link.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nledl.h"
+
+struct nledl_ctx {
+    char *srcpath; /* the installed libnethack.so */
+    char *dlpath;  /* our copy of it, until loaded for good */
+    void *dlhandle;
+    nle_ctx_t *nle_ctx;
+
+    /* the copy's writable globals, and what they were right after dlopen() */
+    void *globals;
+    void *globals_init;
+    size_t globals_size;
+
+    /* the loaded special levels, kept from one game to the next */
+    void **splev_cache;
+    void (*free_special_levels)(void);
+
+    nle_ctx_t *(*start)(nle_settings *, nle_obs *, FILE *);
+    nle_ctx_t *(*step)(nle_ctx_t *, nle_obs *);
+    void (*end)(nle_ctx_t *);
+    const void *(*get_message)(nle_ctx_t *, size_t *);
+    int (*check_glyphmap)(nle_ctx_t *);
+
+    char error[256];
+};
+
+static int
+nledl_fail(nledl_ctx *ctx, const char *what, const char *why)
+{
+    snprintf(ctx->error, sizeof ctx->error, "%s: %s", what, why);
+    return -1;
+}
+
+/* dlopen() keys loaded objects by file, so a copy gets its own globals. */
+static int
+nledl_copy(nledl_ctx *ctx)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char buf[1 << 16];
+    ssize_t n = 0;
+    int in, out;
+
+    if (!tmpdir || !*tmpdir)
+        tmpdir = "/tmp";
+    ctx->dlpath =
+        (char *) malloc(strlen(tmpdir) + sizeof "/libnethack.XXXXXX");
+    if (!ctx->dlpath)
+        return nledl_fail(ctx, "malloc", strerror(errno));
+    sprintf(ctx->dlpath, "%s/libnethack.XXXXXX", tmpdir);
+
+    if ((in = open(ctx->srcpath, O_RDONLY)) < 0) {
+        free(ctx->dlpath);
+        ctx->dlpath = NULL;
+        return nledl_fail(ctx, ctx->srcpath, strerror(errno));
+    }
+    if ((out = mkstemp(ctx->dlpath)) < 0) {
+        nledl_fail(ctx, ctx->dlpath, strerror(errno));
+        close(in);
+        free(ctx->dlpath);
+        ctx->dlpath = NULL;
+        return -1;
+    }
+    while ((n = read(in, buf, sizeof buf)) > 0)
+        if (write(out, buf, n) != n) {
+            n = -1;
+            break;
+        }
+    if (n < 0)
+        nledl_fail(ctx, ctx->dlpath, strerror(errno));
+    close(in);
+    if (close(out) < 0 && n == 0)
+        n = nledl_fail(ctx, ctx->dlpath, strerror(errno));
+    if (n < 0) {
+        unlink(ctx->dlpath);
+        free(ctx->dlpath);
+        ctx->dlpath = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef __ELF__
+/* Finds the writable segment of our copy, less what ld.so made read-only
+   once it had relocated it (PT_GNU_RELRO). */
+static int
+nledl_find_globals(struct dl_phdr_info *info, size_t size, void *data)
+{
+    nledl_ctx *ctx = (nledl_ctx *) data;
+    ElfW(Addr) start = 0, end = 0, relro = 0;
+    int i, segments = 0;
+
+    (void) size;
+    if (!info->dlpi_name || strcmp(info->dlpi_name, ctx->dlpath))
+        return 0;
+    for (i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_W)) {
+            start = phdr->p_vaddr;
+            end = phdr->p_vaddr + phdr->p_memsz;
+            ++segments;
+        } else if (phdr->p_type == PT_GNU_RELRO) {
+            relro = phdr->p_vaddr + phdr->p_memsz;
+        }
+    }
+    if (segments != 1)
+        return 1; /* not a layout we know; reload instead */
+    if (relro > start && relro < end)
+        start = relro;
+    ctx->globals = (void *) (info->dlpi_addr + start);
+    ctx->globals_size = end - start;
+    return 1;
+}
+#endif
+
+/* Saves the globals of a freshly loaded copy for the games after the first
+   one; see nledl.h. */
+static void
+nledl_save_globals(nledl_ctx *ctx)
+{
+#ifdef __ELF__
+    ctx->globals = NULL;
+    dl_iterate_phdr(nledl_find_globals, ctx);
+    if (!ctx->globals)
+        return;
+    if (!(ctx->globals_init = malloc(ctx->globals_size))) {
+        ctx->globals = NULL;
+        return;
+    }
+    memcpy(ctx->globals_init, ctx->globals, ctx->globals_size);
+#endif
+}
+
+static void
+nledl_unload(nledl_ctx *ctx)
+{
+    if (ctx->dlhandle) {
+        if (ctx->free_special_levels)
+            ctx->free_special_levels();
+        dlclose(ctx->dlhandle);
+        ctx->dlhandle = NULL;
+    }
+    ctx->splev_cache = NULL;
+    ctx->free_special_levels = NULL;
+    free(ctx->globals_init);
+    ctx->globals_init = NULL;
+    ctx->globals = NULL;
+}
+
+static void *
+nledl_sym(nledl_ctx *ctx, const char *symbol)
+{
+    void *sym = dlsym(ctx->dlhandle, symbol);
+
+    if (!sym)
+        nledl_fail(ctx, symbol, dlerror());
+    return sym;
+}
+
+nledl_ctx *
+nledl_open(const char *dlpath)
+{
+    nledl_ctx *ctx = (nledl_ctx *) calloc(1, sizeof(nledl_ctx));
+
+    if (!ctx)
+        return NULL;
+    if (!(ctx->srcpath = strdup(dlpath))) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+int
+nledl_start(nledl_ctx *ctx, nle_settings *settings, nle_obs *obs,
+            FILE *ttyrec)
+{
+    void *h;
+
+    nledl_end(ctx);
+    ctx->error[0] = '\0';
+
+    if (ctx->dlhandle) {
+        /* a fresh game needs fresh globals, but the special levels it
+           loads don't change */
+        void *splev_cache = *ctx->splev_cache;
+
+        memcpy(ctx->globals, ctx->globals_init, ctx->globals_size);
+        *ctx->splev_cache = splev_cache;
+    } else {
+        if (!ctx->dlpath && nledl_copy(ctx))
+            return -1;
+
+        if ((h = dlopen(ctx->dlpath, RTLD_LAZY | RTLD_NOLOAD))) {
+            dlclose(h);
+            return nledl_fail(ctx, ctx->dlpath, "still loaded");
+        }
+        ctx->dlhandle = dlopen(ctx->dlpath, RTLD_LAZY | RTLD_LOCAL);
+        if (!ctx->dlhandle)
+            return nledl_fail(ctx, ctx->dlpath, dlerror());
+
+        if (!(ctx->start = nledl_sym(ctx, "nle_start"))
+            || !(ctx->step = nledl_sym(ctx, "nle_step"))
+            || !(ctx->end = nledl_sym(ctx, "nle_end"))
+            || !(ctx->get_message = nledl_sym(ctx, "nle_get_message"))
+            || !(ctx->splev_cache = nledl_sym(ctx, "sp_lev_cache"))
+            || !(ctx->free_special_levels =
+                     nledl_sym(ctx, "free_special_levels"))) {
+            nledl_unload(ctx);
+            return -1;
+        }
+        /* only there with EXTRA_SANITY_CHECKS */
+        ctx->check_glyphmap = dlsym(ctx->dlhandle, "nle_check_glyphmap");
+        nledl_save_globals(ctx);
+        if (ctx->globals_init) {
+            /* never reloaded, so the file can go now, rather than be left
+               behind should this process die */
+            unlink(ctx->dlpath);
+            free(ctx->dlpath);
+            ctx->dlpath = NULL;
+        }
+    }
+
+    ctx->nle_ctx = ctx->start(settings, obs, ttyrec);
+    if (!ctx->nle_ctx) {
+        nledl_end(ctx);
+        return nledl_fail(ctx, "nle_start", "couldn't start NetHack");
+    }
+    return 0;
+}
+
+void
+nledl_step(nledl_ctx *ctx, nle_obs *obs)
+{
+    if (ctx->nle_ctx)
+        ctx->nle_ctx = ctx->step(ctx->nle_ctx, obs);
+}
+
+const void *
+nledl_get_message(nledl_ctx *ctx, size_t *size)
+{
+    if (!ctx->nle_ctx) {
+        *size = 0;
+        return NULL;
+    }
+    return ctx->get_message(ctx->nle_ctx, size);
+}
+
+int
+nledl_check_glyphmap(nledl_ctx *ctx)
+{
+    if (!ctx->nle_ctx || !ctx->check_glyphmap)
+        return -1;
+    return ctx->check_glyphmap(ctx->nle_ctx);
+}
+
+void
+nledl_end(nledl_ctx *ctx)
+{
+    if (ctx->nle_ctx) {
+        ctx->end(ctx->nle_ctx);
+        ctx->nle_ctx = NULL;
+    }
+    if (!ctx->globals_init)
+        nledl_unload(ctx); /* can't reset the globals, reload them */
+}
+
+void
+nledl_close(nledl_ctx *ctx)
+{
+    nledl_end(ctx);
+    nledl_unload(ctx);
+    if (ctx->dlpath) {
+        unlink(ctx->dlpath);
+        free(ctx->dlpath);
+    }
+    free(ctx->srcpath);
+    free(ctx);
+}
+
+const char *
+nledl_error(nledl_ctx *ctx)
+{
+    return ctx->error;
+}
@@ -7,6 +7,9 @@
 
 #include "hack.h"
 #include "dlb.h"
+#ifdef NLE_LIB
+#include "nle.h"
+#endif
 
 #include <ctype.h>
 #include <sys/stat.h>
@@ -15,6 +18,17 @@
 #ifndef O_RDONLY
 #include <fcntl.h>
 #endif
+#ifndef NLE_LIB
+#include <errno.h>
+#include <setjmp.h>
+#ifdef __ELF__
+#include <link.h>
+#endif
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#endif
 
 #if !defined(_BULL_SOURCE) && !defined(__sgi) && !defined(_M_UNIX)
 #if !defined(SUNOS4) && !(defined(ULTRIX) && defined(__GNUC__))
@@ -31,6 +45,25 @@ static void FDECL(chdirx, (const char *, BOOLEAN_P));
 #endif /* CHDIR */
 static boolean NDECL(whoami);
 static void FDECL(process_options, (int, char **));
+#ifndef NLE_LIB
+static void FDECL(nle_zygote, (int));
+static void FDECL(nle_reuse, (int, int, char **));
+static void FDECL(nle_warn, (const char *));
+static int NDECL(nle_open_snapshot);
+#ifdef __ELF__
+static int FDECL(nle_find_globals,
+                 (struct dl_phdr_info *, size_t, genericptr_t));
+#endif
+
+/* NLE_REUSE, see nle_reuse() */
+static int nle_reuse_sock = -1;
+static sigjmp_buf nle_reuse_env;
+static genericptr_t nle_globals, nle_globals_init;
+static size_t nle_globals_size;
+
+extern struct sp_lev_cache *sp_lev_cache; /* sp_lev.c */
+extern char **environ;
+#endif
 
 #ifdef _M_UNIX
 extern void NDECL(check_sco_console);
@@ -45,8 +78,14 @@ static void NDECL(wd_message);
 static boolean wiz_error_flag = FALSE;
 static struct passwd *NDECL(get_unix_pw);
 
+#ifdef NLE_LIB
+/* libnethack.so: called on the game's own stack by nle_start() */
+int
+nhmain(argc, argv)
+#else
 int
 main(argc, argv)
+#endif
 int argc;
 char *argv[];
 {
@@ -57,10 +96,17 @@ char *argv[];
     boolean exact_username;
     boolean resuming = FALSE; /* assume new game */
     boolean plsel_once = FALSE;
+#ifndef NLE_LIB
+    char *zygote, *reuse;
+
+    /* before anything else, as every game starts over from here */
+    if (nle_reuse_sock < 0 && (reuse = nh_getenv("NLE_REUSE")) != 0)
+        nle_reuse(atoi(reuse), argc, argv);
+#endif
 
     sys_early_init();
 
-#if defined(__APPLE__)
+#if defined(__APPLE__) && !defined(NLE_LIB)
     {
 /* special hack to change working directory to a resource fork when
    running from finder --sam */
@@ -94,7 +140,11 @@ char *argv[];
 
     hname = argv[0];
     hackpid = getpid();
+#ifndef NLE_LIB /* leave the host program's umask alone */
     (void) umask(0777 & ~FCMASK);
+#endif
+    /* NLE: no lock, level, record, log or bones files, see topten() */
+    iflags.diskless = (nh_getenv("NLE_DISKLESS") != 0);
 
     choose_windows(DEFAULT_WINDOW_SYS);
 
@@ -184,11 +234,11 @@ char *argv[];
 #ifdef _M_UNIX
     check_sco_console();
 #endif
-#ifdef __linux__
+#if defined(__linux__) && !defined(NLE_LIB)
     check_linux_console();
 #endif
     initoptions();
-#ifdef PANICTRACE
+#if defined(PANICTRACE) && !defined(NLE_LIB)
     ARGV0 = hname; /* save for possible stack trace */
 #ifndef NO_SIGNAL
     panictrace_setsignals(TRUE);
@@ -201,7 +251,7 @@ char *argv[];
      */
     u.uhp = 1; /* prevent RIP on early quits */
     program_state.preserve_locks = 1;
-#ifndef NO_SIGNAL
+#if !defined(NO_SIGNAL) && !defined(NLE_LIB)
     sethanguphandler((SIG_RET_TYPE) hangup);
 #endif
 
@@ -213,7 +263,7 @@ char *argv[];
 #ifdef _M_UNIX
     init_sco_cons();
 #endif
-#ifdef __linux__
+#if defined(__linux__) && !defined(NLE_LIB)
     init_linux_cons();
 #endif
 
@@ -252,9 +302,11 @@ char *argv[];
         /* use character name rather than lock letter for file names */
         locknum = 0;
     } else {
+#ifndef NLE_LIB /* signals belong to the host program */
         /* suppress interrupts while processing lock file */
         (void) signal(SIGQUIT, SIG_IGN);
         (void) signal(SIGINT, SIG_IGN);
+#endif
     }
 
     dlb_init(); /* must be before newgame() */
@@ -267,6 +319,15 @@ char *argv[];
 
     display_gamewindows();
 
+#ifndef NLE_LIB
+    /* Everything up to here is the same for every game: with NLE_ZYGOTE,
+       the rest is forked off once per game, see nle_zygote(). */
+    if (nle_reuse_sock < 0 && (zygote = nh_getenv("NLE_ZYGOTE")) != 0) {
+        preload_special(); /* once, for all the games */
+        nle_zygote(atoi(zygote));
+    }
+#endif
+
     /*
      * First, try to find and restore a save file for specified character.
      * We'll return here if new game player_selection() renames the hero.
@@ -285,15 +346,24 @@ char *argv[];
      * (for locknum > 0).
      */
     if (*plname) {
-        getlock();
+        if (!iflags.diskless)
+            getlock();
         program_state.preserve_locks = 0; /* after getlock() */
     }
 
+#ifndef NLE_LIB
+    if (*plname && (fd = nle_open_snapshot()) >= 0) {
+        if (!dorecover(fd))
+            error("Cannot restore NLE_RESTORE.");
+        resuming = TRUE;
+        wd_message();
+    } else
+#endif
     if (*plname && (fd = restore_saved_game()) >= 0) {
         const char *fq_save = fqname(SAVEF, SAVEPREFIX, 1);
 
         (void) chmod(fq_save, 0); /* disallow parallel restores */
-#ifndef NO_SIGNAL
+#if !defined(NO_SIGNAL) && !defined(NLE_LIB)
         (void) signal(SIGINT, (SIG_RET_TYPE) done1);
 #endif
 #ifdef NEWS
@@ -336,7 +406,7 @@ char *argv[];
                    if locking alphabetically, the existing lock file
                    can still be used; otherwise, discard current one
                    and create another for the new character name */
-                if (!locknum) {
+                if (!locknum && !iflags.diskless) {
                     delete_levelfile(0); /* remove empty lock file */
                     getlock();
                 }
@@ -355,6 +425,487 @@ char *argv[];
     return 0;
 }
 
+#ifndef NLE_LIB
+/*
+ * Requests for a new game, to the zygote, NLE_REUSE or a game's NLE_CONTROL
+ * socket, are datagrams of NAME=VALUE lines to setenv() in the new game
+ * (HACKDIR, NLE_SEED_CORE, ...), with the new game's NLE_SHM ring and
+ * NLE_SHM_NOTIFY, NLE_SHM_ACTION and NLE_CONTROL ends attached, in that
+ * order.  The reply is the new game's pid as text, "-1" if fork() failed.
+ */
+static const char *nle_request_fds[] = { "NLE_SHM", "NLE_SHM_NOTIFY",
+                                         "NLE_SHM_ACTION", "NLE_CONTROL" };
+#define NLE_REQUEST_FDS SIZE(nle_request_fds)
+
+/* raw_print(), but NLE_REUSE waits for requests before there is a window
+   port to print with. */
+static void
+nle_warn(msg)
+const char *msg;
+{
+    if (windowprocs.win_raw_print)
+        raw_print(msg);
+    else
+        (void) fprintf(stderr, "%s\n", msg);
+}
+
+/* Receives a request into buf, and the fds attached to it, if any, into
+   fds.  Returns 0 once the other end is gone and -1 for a request with
+   some other number of fds, which is dropped. */
+static int
+nle_recv_request(sock, buf, size, fds, nfds)
+int sock;
+char *buf;
+size_t size;
+int *fds;
+size_t *nfds;
+{
+    union {
+        struct cmsghdr hdr;
+        char space[CMSG_SPACE(NLE_REQUEST_FDS * sizeof (int))];
+    } control;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+    size_t i;
+
+    iov.iov_base = buf;
+    iov.iov_len = size - 1;
+    (void) memset((genericptr_t) &msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof control.space;
+
+    while ((n = recvmsg(sock, &msg, 0)) < 0 && errno == EINTR)
+        ;
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+
+    *nfds = 0;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET
+        && cmsg->cmsg_type == SCM_RIGHTS)
+        *nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof (int);
+    if (*nfds && *nfds != NLE_REQUEST_FDS) {
+        for (i = 0; i < *nfds; ++i)
+            (void) close(((int *) CMSG_DATA(cmsg))[i]);
+        nle_warn("NLE: request with the wrong fds");
+        return -1;
+    }
+    if (*nfds)
+        (void) memcpy((genericptr_t) fds, CMSG_DATA(cmsg),
+                      *nfds * sizeof (int));
+    return 1;
+}
+
+static void
+nle_reply(sock, pid)
+int sock;
+long pid;
+{
+    char num[32];
+
+    Sprintf(num, "%ld", pid);
+    (void) send(sock, num, strlen(num), 0);
+}
+
+static void
+nle_close_fds(fds)
+int *fds;
+{
+    size_t i;
+
+    for (i = 0; i < NLE_REQUEST_FDS; ++i)
+        (void) close(fds[i]);
+}
+
+/* In the new game: setenv()s what the request in buf asks for, then
+   moves to the game's HACKDIR, if it has one of its own. */
+static void
+nle_apply_request(buf, fds)
+char *buf;
+int *fds;
+{
+    char num[32], *line, *next, *eq;
+    size_t i;
+
+    /* unset seeds are drawn anew, not inherited; nor is a game to restore */
+    (void) unsetenv("NLE_SEED_CORE");
+    (void) unsetenv("NLE_SEED_DISP");
+    (void) unsetenv("NLE_RESTORE");
+    for (line = buf; *line; line = next) {
+        if ((next = index(line, '\n')) != 0)
+            *next++ = '\0';
+        else
+            next = eos(line);
+        if ((eq = index(line, '=')) != 0) {
+            *eq = '\0';
+            (void) setenv(line, eq + 1, 1);
+        }
+    }
+    for (i = 0; i < NLE_REQUEST_FDS; ++i) {
+        Sprintf(num, "%d", fds[i]);
+        (void) setenv(nle_request_fds[i], num, 1);
+    }
+    /* games may play in a HACKDIR of their own, for their lock files */
+    if ((line = nh_getenv("HACKDIR")) != 0 && chdir(line) < 0) {
+        perror(line);
+        error("Cannot chdir to %s.", line);
+    }
+}
+
+/*
+ * Zygote mode.  The process starting nethack passes one end of a datagram
+ * socket pair as NLE_ZYGOTE and sends requests for new games on it, see
+ * above.  We fork, reply, and the child returns to main() to pick a role
+ * and start the game.  Nobody waits for the games; they are reaped
+ * automatically.  The zygote itself only returns in its children and
+ * exits when the socket is closed.
+ */
+static void
+nle_zygote(sock)
+int sock;
+{
+    char buf[BUFSZ * 4];
+    int fds[NLE_REQUEST_FDS], n;
+    size_t nfds;
+    pid_t pid;
+
+    (void) signal(SIGCHLD, SIG_IGN);
+    for (;;) {
+        if (!(n = nle_recv_request(sock, buf, sizeof buf, fds, &nfds)))
+            exit(EXIT_SUCCESS);
+        if (n < 0)
+            continue;
+        if (!nfds) {
+            raw_print("NLE_ZYGOTE: request without fds");
+            continue;
+        }
+        if ((pid = fork()) == 0)
+            break;
+        nle_close_fds(fds);
+        nle_reply(sock, (long) pid);
+    }
+
+    /* in the new game */
+    (void) close(sock);
+    (void) signal(SIGCHLD, SIG_DFL);
+    hackpid = getpid();
+    nle_apply_request(buf, fds);
+
+    init_random(rn2);
+    init_random(rn2_on_display_rng);
+
+    /* don't share nhdat's file offset with the other games */
+    dlb_unshare();
+}
+
+#ifdef __ELF__
+/* Finds our writable segment, less what ld.so made read-only once it had
+   relocated it (PT_GNU_RELRO).  The first object dl_iterate_phdr() reports
+   is the program itself. */
+static int
+nle_find_globals(info, size, data)
+struct dl_phdr_info *info;
+size_t size;
+genericptr_t data;
+{
+    ElfW(Addr) start = 0, end = 0, relro = 0;
+    int i, segments = 0;
+
+    nhUse(size);
+    nhUse(data);
+    for (i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_W)) {
+            start = phdr->p_vaddr;
+            end = phdr->p_vaddr + phdr->p_memsz;
+            ++segments;
+        } else if (phdr->p_type == PT_GNU_RELRO) {
+            relro = phdr->p_vaddr + phdr->p_memsz;
+        }
+    }
+    if (segments == 1) {
+        if (relro > start && relro < end)
+            start = relro;
+        nle_globals = (genericptr_t) (info->dlpi_addr + start);
+        nle_globals_size = end - start;
+    }
+    return 1;
+}
+#endif
+
+/*
+ * Reuse mode.  As for a zygote, the process starting nethack passes one end
+ * of a datagram socket pair as NLE_REUSE and sends requests for new games
+ * on it, but we play them ourselves, one after the other, and reply with
+ * our own pid.  Before the first game, our globals are saved; once a game
+ * is over, nle_reuse_next() copies them back and we return to main() from
+ * the top for the next request, as nledl.c does for the in-process
+ * library.  The game has freed its data by then (freedynamicdata()), and
+ * the rl window port its own, closing its fds; the special levels loaded
+ * are kept.  The segment copied back also holds what libc's objects were
+ * copied into at link time: stdin, stdout and stderr only point to libc's
+ * own FILEs and come back unchanged, while environ is kept as setenv()
+ * left it.  Where our globals can't be found (not ELF), we play one game
+ * and exit as without NLE_REUSE, and the other end starts another
+ * process.  We exit when the socket is closed.
+ */
+static void
+nle_reuse(sock, argc, argv)
+int sock;
+int argc;
+char **argv;
+{
+    char buf[BUFSZ * 4];
+    int fds[NLE_REQUEST_FDS], n;
+    size_t nfds;
+
+    nle_reuse_sock = sock;
+    if (!sigsetjmp(nle_reuse_env, 1)) {
+#ifdef __ELF__
+        (void) dl_iterate_phdr(nle_find_globals, (genericptr_t) 0);
+        if (nle_globals && (nle_globals_init = malloc(nle_globals_size)))
+            (void) memcpy(nle_globals_init, nle_globals, nle_globals_size);
+#endif
+    }
+
+    for (;;) {
+        if (!(n = nle_recv_request(sock, buf, sizeof buf, fds, &nfds)))
+            exit(EXIT_SUCCESS);
+        if (n < 0)
+            continue;
+        if (!nfds) {
+            nle_warn("NLE_REUSE: request without fds");
+            continue;
+        }
+        break;
+    }
+    nle_reply(sock, (long) getpid());
+    nle_apply_request(buf, fds);
+    exit(main(argc, argv));
+}
+
+/* Called by nh_terminate() before it exits: with NLE_REUSE, starts over in
+   nle_reuse() instead, unless the game ended badly.  See there. */
+void
+nle_reuse_next(status)
+int status;
+{
+    struct sp_lev_cache *splev = sp_lev_cache;
+    char **env = environ;
+
+    if (nle_reuse_sock < 0 || !nle_globals_init || status != EXIT_SUCCESS
+        || program_state.panicking || program_state.done_hup)
+        return;
+    (void) memcpy(nle_globals, nle_globals_init, nle_globals_size);
+    /* loaded once, for all the games; setenv() may have moved environ */
+    sp_lev_cache = splev;
+    environ = env;
+    siglongjmp(nle_reuse_env, 1);
+}
+
+/* Copies the level files from the directory olddir to the current one.
+   With LEVELS_IN_MEMORY, that's only the lock file: the other levels are
+   kept in memory, see create_levelfile(), and so forked off with the
+   game. */
+static void
+nle_copy_levels(olddir)
+int olddir;
+{
+    char buf[BUFSZ * 4], whynot[BUFSZ];
+    int lev, in, out;
+    ssize_t n;
+
+    for (lev = 0; lev < MAXLINFO; ++lev) {
+#ifdef LEVELS_IN_MEMORY
+        if (lev)
+            break;
+#endif
+        if (lev && !(level_info[lev].flags & LFILE_EXISTS))
+            continue;
+        set_levelfile_name(lock, lev);
+        if ((in = openat(olddir, fqname(lock, LEVELPREFIX, 0), O_RDONLY)) < 0)
+            continue; /* no lock file (yet) */
+        if ((out = create_levelfile(lev, whynot)) < 0)
+            error("%s", whynot);
+        while ((n = read(in, buf, sizeof buf)) > 0)
+            if (write(out, buf, n) != n)
+                n = -1;
+        /* the lock file starts with the pid of the game holding it */
+        if (n < 0
+            || (!lev
+                && pwrite(out, (genericptr_t) &hackpid, sizeof hackpid, 0)
+                       != sizeof hackpid))
+            error("Cannot copy %s.", lock);
+        (void) close(in);
+        (void) close(out);
+    }
+}
+
+/* The copy's half of nle_control()'s branching, see there. */
+static void
+nle_branch(sock, buf, fds)
+int sock;
+char *buf;
+int *fds;
+{
+    int n, olddir;
+
+    (void) close(sock);
+    if (nle_reuse_sock >= 0) {
+        /* the copy is a game of its own, not one to reuse */
+        (void) close(nle_reuse_sock);
+        nle_reuse_sock = -1;
+    }
+    (void) setsid();
+    if ((n = open("/dev/null", O_RDWR)) >= 0) {
+        (void) dup2(n, 0);
+        (void) dup2(n, 1);
+        (void) close(n);
+    }
+    hackpid = getpid();
+
+    if (iflags.diskless) {
+        nle_apply_request(buf, fds);
+    } else {
+        if ((olddir = open(".", O_RDONLY | O_DIRECTORY)) < 0)
+            error("Cannot open the game's HACKDIR.");
+        nle_apply_request(buf, fds);
+        nle_copy_levels(olddir);
+        (void) close(olddir);
+    }
+
+    if (nh_getenv("NLE_SEED_CORE"))
+        init_random(rn2);
+    if (nh_getenv("NLE_SEED_DISP"))
+        init_random(rn2_on_display_rng);
+
+    dlb_unshare();
+}
+
+/* Replies with the size of a snapshot of the game and a file holding it,
+   or with "-1" alone if there is no game to save yet. */
+static void
+nle_snapshot(sock)
+int sock;
+{
+    union {
+        struct cmsghdr hdr;
+        char space[CMSG_SPACE(sizeof (int))];
+    } control;
+    char num[32];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    long size = -1L;
+    int fd, copy;
+
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("nle-snapshot", MFD_CLOEXEC);
+#else
+    Strcpy(num, "nle-snapshot.XXXXXX");
+    if ((fd = mkstemp(num)) >= 0)
+        (void) unlink(num);
+#endif
+    if (fd >= 0 && (copy = dup(fd)) >= 0) {
+        if (savesnapshot(copy))
+            size = (long) lseek(fd, (off_t) 0, SEEK_END);
+        else
+            (void) close(copy);
+    }
+
+    Sprintf(num, "%ld", size);
+    iov.iov_base = num;
+    iov.iov_len = strlen(num);
+    (void) memset((genericptr_t) &msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (size >= 0) {
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof control.space;
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof (int));
+        (void) memcpy(CMSG_DATA(cmsg), (genericptr_t) &fd, sizeof (int));
+    }
+    (void) sendmsg(sock, &msg, 0);
+    if (fd >= 0)
+        (void) close(fd);
+}
+
+/*
+ * Requests on NLE_CONTROL, which the rl window port hands to us while the
+ * game waits for a key.
+ *
+ * A request as for the zygote asks for a copy of the game: it is forked
+ * off as the game is, RNGs included unless the request sets seeds, and
+ * gets the lock file copied into the HACKDIR the request must give it.
+ * It is forked twice, so that it is nobody's child, and runs in a session
+ * of its own so that it outlives the game's pty.
+ *
+ * A request without fds asks for a snapshot: the game in save file format,
+ * as savesnapshot() writes it.  The game goes on; a new game started with
+ * NLE_RESTORE naming a file with the snapshot continues from it.
+ *
+ * Returns 1 in a copy, which then has to drop the game's NLE_SHM and
+ * connect to its own, 0 in the game and -1 once the socket is closed.
+ */
+int
+nle_control(sock)
+int sock;
+{
+    char buf[BUFSZ * 4];
+    int fds[NLE_REQUEST_FDS], n, status;
+    size_t nfds;
+    pid_t pid;
+
+    if ((n = nle_recv_request(sock, buf, sizeof buf, fds, &nfds)) <= 0)
+        return n ? 0 : -1;
+    if (!nfds) {
+        nle_snapshot(sock);
+        return 0;
+    }
+
+    if ((pid = fork()) < 0) {
+        nle_reply(sock, -1L);
+    } else if (pid > 0) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+    } else {
+        if ((pid = fork()) != 0) {
+            nle_reply(sock, (long) pid);
+            _exit(EXIT_SUCCESS);
+        }
+        nle_branch(sock, buf, fds);
+        return 1;
+    }
+    nle_close_fds(fds);
+    return 0;
+}
+
+/* The snapshot to restore instead of starting a new game, if any. */
+static int
+nle_open_snapshot()
+{
+    const char *path = nh_getenv("NLE_RESTORE");
+    int fd;
+
+    if (!path)
+        return -1;
+    if ((fd = open(path, O_RDONLY, 0)) < 0 || validate(fd, path) != 0)
+        error("Cannot restore NLE_RESTORE %s.", path);
+    /* snapshots may come from other machines */
+    sysopt.check_save_uid = 0;
+    return fd;
+}
+#endif /* !NLE_LIB */
+
 /* caveat: argv elements might be arbitrary long */
 static void
 process_options(argc, argv)
@@ -512,10 +1063,26 @@ boolean wr;
         dir = HACKDIR;
 #endif
 
+#ifdef NLE_LIB
+    /* The working directory is shared with the host program (and any other
+     * games it runs), so instead of changing into the playground, make all
+     * file names relative to it.
+     */
+    if (dir) {
+        int i;
+
+        for (i = 0; i < PREFIX_COUNT; i++) {
+            fqn_prefix[i] = (char *) alloc(strlen(dir) + 2);
+            Strcpy(fqn_prefix[i], dir);
+            append_slash(fqn_prefix[i]);
+        }
+    }
+#else
     if (dir && chdir(dir) < 0) {
         perror(dir);
         error("Cannot chdir to %s.", dir);
     }
+#endif
 
     /* warn the player if we can't write the record file
      * perhaps we should also test whether . is writable
@@ -529,7 +1096,8 @@ boolean wr;
         fqn_prefix[LOCKPREFIX] = fqn_prefix[SCOREPREFIX];
         fqn_prefix[TROUBLEPREFIX] = fqn_prefix[SCOREPREFIX];
 #endif
-        check_recordfile(dir);
+        if (!iflags.diskless)
+            check_recordfile(dir);
     }
 }
 #endif /* CHDIR */
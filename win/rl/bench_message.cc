@@ -0,0 +1,198 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+
+/*
+ * bench_message.cc: allocations and time per Message handed to ZMQ the way
+ * winrl.cc used to (a FlatBufferBuilder and vectors of offsets per
+ * message, copied into a zmq::message_t of its size) and the way it does
+ * now (one builder and vectors reused, the message_t made from the
+ * builder's buffer, which zmq_msg_init_data() still mallocs a small
+ * header for).  The messages are closed rather than sent: socket I/O
+ * isn't measured.
+ *
+ * build() is not NetHackRL::build_message(), which needs a running game,
+ * but a stand-in for it: the same tables, shaped like a Message from the
+ * middle of a game (all map NDArrays, a full status, a 20-item inventory
+ * and a few windows).  Allocations are all calls to malloc(), C++'s and
+ * libzmq's, counted by wrapping glibc's.
+ * make bench_message in src; it needs flatbuffers and libzmq, not NetHack.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "message_generated.h"
+#include <flatbuffers/flatbuffers.h>
+#include <zmq.hpp>
+
+extern "C" void *__libc_malloc(size_t);
+
+namespace
+{
+const int ROWS = 21, COLS = 79, MESSAGES = 10000;
+
+size_t allocations = 0;
+
+struct game_state {
+    std::vector<std::vector<std::string> > windows;
+    std::vector<std::string> status;
+    std::vector<std::string> inventory;
+    std::vector<std::string> call_stack;
+    std::vector<int16_t> glyphs;
+    std::vector<uint8_t> chars, colors, specials;
+
+    game_state()
+        : windows(5), status(21, "Agent the Digger"), inventory(20),
+          call_stack({ "nhgetch", "rhack", "moveloop" }),
+          glyphs(ROWS * COLS, 2359), chars(ROWS * COLS, ' '),
+          colors(ROWS * COLS), specials(ROWS * COLS)
+    {
+        windows[0] = { "You see here a scroll labeled ELBIB YLOH." };
+        for (int i = 0; i < 20; ++i)
+            inventory[i] = "a +2 pair of leather gloves (being worn)";
+    }
+};
+
+struct scratch {
+    std::vector<flatbuffers::Offset<flatbuffers::String> > strings;
+    std::vector<flatbuffers::Offset<nle::fbs::Window> > windows;
+    std::vector<flatbuffers::Offset<nle::fbs::InventoryItem> > inventory;
+};
+
+/* Builds a Message like build_message()'s into builder, with vectors of
+   offsets in scratch. */
+void
+build(const game_state &game, flatbuffers::FlatBufferBuilder &builder,
+      scratch &s)
+{
+    s.windows.clear();
+    for (const auto &strings : game.windows) {
+        s.strings.clear();
+        for (const std::string &str : strings)
+            s.strings.push_back(builder.CreateString(str));
+        auto fb_strings =
+            s.strings.empty() ? 0 : builder.CreateVector(s.strings);
+        s.windows.push_back(nle::fbs::CreateWindow(builder, 0, 0, fb_strings));
+    }
+    auto fb_windows = builder.CreateVector(s.windows);
+
+    flatbuffers::Offset<flatbuffers::String> st[21];
+    for (int i = 0; i < 21; ++i)
+        st[i] = builder.CreateString(game.status[i]);
+    auto fb_status = nle::fbs::CreateStatus(
+        builder, st[0], st[1], st[2], st[3], st[4], st[5], st[6], st[7],
+        st[8], st[9], st[10], st[11], st[12], st[13], st[14], st[15], st[16],
+        st[17], st[18], st[19], st[20]);
+
+    static const int64_t shape[] = { ROWS, COLS };
+    auto ndarray = [&](const void *data, size_t size, int dtype) {
+        auto fb_shape = builder.CreateVector(shape, 2);
+        auto fb_data =
+            builder.CreateVector(static_cast<const uint8_t *>(data), size);
+        return nle::fbs::CreateNDArray(builder, fb_shape, dtype, fb_data);
+    };
+    auto fb_glyphs = ndarray(game.glyphs.data(),
+                             game.glyphs.size() * sizeof(int16_t), 3);
+    auto fb_chars = ndarray(game.chars.data(), game.chars.size(), 2);
+    auto fb_colors = ndarray(game.colors.data(), game.colors.size(), 2);
+    auto fb_specials = ndarray(game.specials.data(), game.specials.size(), 2);
+
+    s.inventory.clear();
+    for (const std::string &str : game.inventory) {
+        auto fb_str = builder.CreateString(str);
+        auto fb_class_name = builder.CreateString("Armor");
+        s.inventory.push_back(nle::fbs::CreateInventoryItem(
+            builder, 1913, fb_str, 'a', 3, fb_class_name));
+    }
+    auto fb_inventory = builder.CreateVector(s.inventory);
+
+    auto fb_observation = nle::fbs::CreateObservation(
+        builder, fb_glyphs, fb_chars, fb_colors, fb_specials, fb_status,
+        fb_inventory);
+
+    s.strings.clear();
+    for (const std::string &call : game.call_stack)
+        s.strings.push_back(builder.CreateString(call));
+    auto fb_internal = nle::fbs::CreateInternal(
+        builder, 1, builder.CreateVector(s.strings));
+
+    builder.Finish(nle::fbs::CreateMessage(builder, fb_observation, 0, 0,
+                                           fb_windows, fb_internal));
+}
+
+/* As before: new builder, new vectors and a copy of the finished buffer
+   in a zmq::message_t(size). */
+size_t
+send_fresh(const game_state &game)
+{
+    flatbuffers::FlatBufferBuilder builder(1024);
+    scratch s;
+    build(game, builder, s);
+
+    zmq::message_t reply(builder.GetSize());
+    memcpy(reply.data(), builder.GetBufferPointer(), builder.GetSize());
+    return reply.size();
+}
+
+void
+release_message(void *, void *)
+{
+}
+
+/* As now: the builder and vectors are cleared and reused; the buffer is
+   handed to ZMQ as it is, with a function to release it. */
+size_t
+send_reused(const game_state &game, flatbuffers::FlatBufferBuilder &builder,
+            scratch &s)
+{
+    builder.Clear();
+    build(game, builder, s);
+
+    zmq::message_t reply(builder.GetBufferPointer(), builder.GetSize(),
+                         release_message, nullptr);
+    return reply.size();
+}
+
+template <typename F>
+void
+report(const char *name, F send)
+{
+    size_t bytes = send(); /* warm up */
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MESSAGES; ++i)
+        bytes = send();
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    printf("%-8s %6zu bytes/message %8.2f mallocs/message "
+           "%8.2f us/message\n",
+           name, bytes, (double) (allocations - before) / MESSAGES,
+           elapsed.count() / MESSAGES);
+}
+} // namespace
+
+/* Counts the allocations of C++'s operator new and of libzmq alike. */
+extern "C" void *
+malloc(size_t size) noexcept
+{
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+int
+main()
+{
+    game_state game;
+    flatbuffers::FlatBufferBuilder builder(1 << 16);
+    scratch s;
+
+    report("fresh", [&] { return send_fresh(game); });
+    report("reused", [&] { return send_reused(game, builder, s); });
+    printf("(stand-in Messages, into zmq::message_t; no socket I/O)\n");
+    return 0;
+}
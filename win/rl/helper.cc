@@ -1,6 +1,15 @@
 /* Copyright (c) Facebook, Inc. and its affiliates. */
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 
+#include "message_generated.h"
+#include <flatbuffers/flatbuffers.h>
+
 // "digit" is declared in both Python's longintrepr.h and NetHack's extern.h.
 #define digit nethack_digit
 
@@ -10,6 +19,8 @@
 #include "rm.h"
 #include "wintty.h"
 
+#include "nleobs.h"
+
 // Undef name clashes between NetHack and Python.
 #undef yn
 #undef min
@@ -18,12 +29,252 @@
 // From drawing.c. Needs drawing.o at link time.
 extern const struct class_sym def_monsyms[MAXMCLASSES];
 
+// objects[] is from objects.c, via decl.h. Needs objects.o at link time.
+
 namespace py = pybind11;
 
+namespace
+{
+// Index of the message window in Message.windows. WIN_MESSAGE itself is
+// only set once NetHack runs; it's always this one, as in base.py.
+const size_t win_message = 1;
+
+// The fields of nle_obs decode_into() fills in, see include/nleobs.h.
+struct decode_targets {
+    int16_t *glyphs = nullptr;
+    uint8_t *chars = nullptr;
+    uint8_t *colors = nullptr;
+    uint8_t *specials = nullptr;
+    int16_t *glyphs_crop = nullptr;
+    size_t glyphs_crop_size = 0;
+    int32_t *blstats = nullptr;
+    uint8_t *message = nullptr;
+    int16_t *inv_glyphs = nullptr;
+    uint8_t *inv_strs = nullptr;
+    uint8_t *inv_letters = nullptr;
+    uint8_t *inv_oclasses = nullptr;
+};
+
+// out[key] if it's there, checked to be a writeable C-contiguous array of
+// shape (-1 matches any size) and dtype T; its data is written to without
+// the GIL, so arrays holds on to it until then. Its size goes to *size.
+template <typename T>
+T *
+decode_target(const py::dict &out, const char *key,
+              std::vector<py::ssize_t> shape, std::vector<py::object> &arrays,
+              size_t *size = nullptr)
+{
+    using array_t = py::array_t<T, py::array::c_style>;
+
+    if (!out.contains(key))
+        return nullptr;
+    py::object obj = out[key];
+    if (!py::isinstance<array_t>(obj))
+        throw py::type_error(std::string(key) + ": expected a C-contiguous "
+                             + py::str(py::dtype::of<T>()).cast<std::string>()
+                             + " array");
+    auto array = py::reinterpret_borrow<array_t>(obj);
+    if ((size_t) array.ndim() != shape.size()
+        || !std::equal(shape.begin(), shape.end(), array.shape(),
+                       [](py::ssize_t expected, py::ssize_t actual) {
+                           return expected == -1 || expected == actual;
+                       }))
+        throw py::value_error(std::string(key) + ": wrong shape");
+    if (size)
+        *size = array.size();
+    arrays.push_back(obj);
+    return array.mutable_data(); // Throws if read-only.
+}
+
+template <typename T>
+void
+decode_ndarray(const nle::fbs::NDArray *ndarray, T *out, size_t size)
+{
+    if (!out)
+        return;
+    if (!ndarray || !ndarray->data()
+        || ndarray->data()->size() != size * sizeof(T)) {
+        memset(out, 0, size * sizeof(T));
+        return;
+    }
+    memcpy(out, ndarray->data()->data(), size * sizeof(T));
+}
+
+// Same as nle_obs.message from fill_obs() in winrl.cc.
+void
+decode_message(const nle::fbs::Message *message, uint8_t *out)
+{
+    if (!out)
+        return;
+    memset(out, 0, NLE_MESSAGE_SIZE);
+    if (message->not_running() || !message->windows()
+        || message->windows()->size() <= win_message)
+        return;
+    auto strings = message->windows()->Get(win_message)->strings();
+    if (!strings)
+        return;
+    size_t offset = 0;
+    for (auto s : *strings) {
+        if (offset >= NLE_MESSAGE_SIZE)
+            break;
+        size_t n = std::min<size_t>(s->size(), NLE_MESSAGE_SIZE - offset - 1);
+        memcpy(out + offset, s->data(), n);
+        offset += n + 1; // Keep one NUL as separator.
+    }
+}
+
+// Same as the inv_* fields of nle_obs from fill_obs() in winrl.cc.
+void
+decode_inventory(const nle::fbs::Observation *observation,
+                 const decode_targets &t)
+{
+    if (t.inv_glyphs)
+        std::fill_n(t.inv_glyphs, NLE_INVENTORY_SIZE, NO_GLYPH);
+    if (t.inv_strs)
+        memset(t.inv_strs, 0,
+               NLE_INVENTORY_SIZE * NLE_INVENTORY_STR_LENGTH);
+    if (t.inv_letters)
+        memset(t.inv_letters, 0, NLE_INVENTORY_SIZE);
+    if (t.inv_oclasses)
+        memset(t.inv_oclasses, MAXOCLASSES, NLE_INVENTORY_SIZE);
+    if (!observation || !observation->inventory())
+        return;
+
+    auto inventory = observation->inventory();
+    size_t n = std::min<size_t>(inventory->size(), NLE_INVENTORY_SIZE);
+    for (size_t i = 0; i < n; ++i) {
+        auto item = inventory->Get(i);
+        if (t.inv_glyphs)
+            t.inv_glyphs[i] = item->glyph();
+        if (t.inv_strs && item->str())
+            memcpy(t.inv_strs + i * NLE_INVENTORY_STR_LENGTH,
+                   item->str()->data(),
+                   std::min<size_t>(item->str()->size(),
+                                    NLE_INVENTORY_STR_LENGTH - 1));
+        if (t.inv_letters)
+            t.inv_letters[i] = item->letter();
+        if (t.inv_oclasses)
+            t.inv_oclasses[i] = item->object_class();
+    }
+}
+
+void
+decode(const nle::fbs::Message *message, const decode_targets &t)
+{
+    static_assert(sizeof(nle::fbs::Blstats)
+                      == NLE_BLSTATS_SIZE * sizeof(int32_t),
+                  "Blstats doesn't match nle_obs.blstats");
+    const size_t map_size = NLE_MAP_ROWS * NLE_MAP_COLS;
+    auto observation = message->observation();
+
+    decode_ndarray(observation ? observation->glyphs() : nullptr, t.glyphs,
+                   map_size);
+    decode_ndarray(observation ? observation->chars() : nullptr, t.chars,
+                   map_size);
+    decode_ndarray(observation ? observation->colors() : nullptr, t.colors,
+                   map_size);
+    decode_ndarray(observation ? observation->specials() : nullptr,
+                   t.specials, map_size);
+    decode_ndarray(observation ? observation->glyphs_crop() : nullptr,
+                   t.glyphs_crop, t.glyphs_crop_size);
+    if (t.blstats) {
+        if (message->blstats())
+            memcpy(t.blstats, message->blstats(), sizeof(nle::fbs::Blstats));
+        else
+            memset(t.blstats, 0, sizeof(nle::fbs::Blstats));
+    }
+    decode_message(message, t.message);
+    decode_inventory(observation, t);
+}
+
+// Kinds of glyphs, in the order of their offsets in display.h; NONE is for
+// anything that isn't a glyph, such as NO_GLYPH.
+enum glyph_group {
+    GLYPH_GROUP_MON,
+    GLYPH_GROUP_PET,
+    GLYPH_GROUP_INVIS,
+    GLYPH_GROUP_DETECT,
+    GLYPH_GROUP_BODY,
+    GLYPH_GROUP_RIDDEN,
+    GLYPH_GROUP_OBJ,
+    GLYPH_GROUP_CMAP,
+    GLYPH_GROUP_EXPLODE,
+    GLYPH_GROUP_ZAP,
+    GLYPH_GROUP_SWALLOW,
+    GLYPH_GROUP_WARNING,
+    GLYPH_GROUP_STATUE,
+    GLYPH_GROUP_NONE
+};
+
+const int glyph_group_offsets[GLYPH_GROUP_NONE] = {
+    GLYPH_MON_OFF,     GLYPH_PET_OFF,     GLYPH_INVIS_OFF,
+    GLYPH_DETECT_OFF,  GLYPH_BODY_OFF,    GLYPH_RIDDEN_OFF,
+    GLYPH_OBJ_OFF,     GLYPH_CMAP_OFF,    GLYPH_EXPLODE_OFF,
+    GLYPH_ZAP_OFF,     GLYPH_SWALLOW_OFF, GLYPH_WARNING_OFF,
+    GLYPH_STATUE_OFF,
+};
+
+// What decompose_glyphs() returns for a glyph. id is the glyph's offset
+// in its group: a monster, object or cmap index, or the like. Glyphs
+// showing no monster have mlet MAXMCLASSES, showing no object oc_class
+// MAXOCLASSES.
+struct glyph_parts {
+    uint8_t group;
+    int16_t id;
+    uint8_t mlet;
+    uint8_t oc_class;
+};
+
+// One more than MAX_GLYPH, the last one is for non-glyphs.
+glyph_parts glyph_table[MAX_GLYPH + 1];
+
+void
+init_glyph_table()
+{
+    for (int glyph = 0; glyph <= MAX_GLYPH; ++glyph) {
+        glyph_parts &p = glyph_table[glyph];
+        p = { GLYPH_GROUP_NONE, 0, MAXMCLASSES, MAXOCLASSES };
+        if (glyph == MAX_GLYPH)
+            break;
+
+        int group = GLYPH_GROUP_NONE - 1;
+        while (glyph < glyph_group_offsets[group])
+            --group;
+        p.group = group;
+        p.id = glyph - glyph_group_offsets[group];
+
+        switch (group) {
+        case GLYPH_GROUP_MON:
+        case GLYPH_GROUP_PET:
+        case GLYPH_GROUP_DETECT:
+        case GLYPH_GROUP_RIDDEN:
+            p.mlet = mons[p.id].mlet;
+            break;
+        case GLYPH_GROUP_BODY:
+            p.mlet = mons[p.id].mlet;
+            p.oc_class = objects[CORPSE].oc_class;
+            break;
+        case GLYPH_GROUP_STATUE:
+            p.mlet = mons[p.id].mlet;
+            p.oc_class = objects[STATUE].oc_class;
+            break;
+        case GLYPH_GROUP_SWALLOW: // See swallow_to_glyph() in display.c.
+            p.mlet = mons[p.id >> 3].mlet;
+            break;
+        case GLYPH_GROUP_OBJ:
+            p.oc_class = objects[p.id].oc_class;
+            break;
+        }
+    }
+}
+} // namespace
+
 PYBIND11_MODULE(helper, m)
 {
     m.doc() = "Helper constants and functions for NetHackRL";
 
+    init_glyph_table();
+
     m.attr("NHW_MESSAGE") = py::int_(NHW_MESSAGE);
     m.attr("NHW_STATUS") = py::int_(NHW_STATUS);
     m.attr("NHW_MAP") = py::int_(NHW_MAP);
@@ -54,6 +305,31 @@ PYBIND11_MODULE(helper, m)
     m.attr("NO_GLYPH") = py::int_(NO_GLYPH);
     m.attr("GLYPH_INVISIBLE") = py::int_(GLYPH_INVISIBLE);
 
+    // Groups of decompose_glyphs().
+    m.attr("GLYPH_GROUP_MON") = py::int_(static_cast<int>(GLYPH_GROUP_MON));
+    m.attr("GLYPH_GROUP_PET") = py::int_(static_cast<int>(GLYPH_GROUP_PET));
+    m.attr("GLYPH_GROUP_INVIS") =
+        py::int_(static_cast<int>(GLYPH_GROUP_INVIS));
+    m.attr("GLYPH_GROUP_DETECT") =
+        py::int_(static_cast<int>(GLYPH_GROUP_DETECT));
+    m.attr("GLYPH_GROUP_BODY") = py::int_(static_cast<int>(GLYPH_GROUP_BODY));
+    m.attr("GLYPH_GROUP_RIDDEN") =
+        py::int_(static_cast<int>(GLYPH_GROUP_RIDDEN));
+    m.attr("GLYPH_GROUP_OBJ") = py::int_(static_cast<int>(GLYPH_GROUP_OBJ));
+    m.attr("GLYPH_GROUP_CMAP") = py::int_(static_cast<int>(GLYPH_GROUP_CMAP));
+    m.attr("GLYPH_GROUP_EXPLODE") =
+        py::int_(static_cast<int>(GLYPH_GROUP_EXPLODE));
+    m.attr("GLYPH_GROUP_ZAP") = py::int_(static_cast<int>(GLYPH_GROUP_ZAP));
+    m.attr("GLYPH_GROUP_SWALLOW") =
+        py::int_(static_cast<int>(GLYPH_GROUP_SWALLOW));
+    m.attr("GLYPH_GROUP_WARNING") =
+        py::int_(static_cast<int>(GLYPH_GROUP_WARNING));
+    m.attr("GLYPH_GROUP_STATUE") =
+        py::int_(static_cast<int>(GLYPH_GROUP_STATUE));
+    m.attr("GLYPH_GROUP_NONE") = py::int_(static_cast<int>(GLYPH_GROUP_NONE));
+
+    m.attr("MAXMCLASSES") = py::int_(static_cast<int>(MAXMCLASSES));
+
     m.attr("MAXPCHARS") = py::int_(static_cast<int>(MAXPCHARS));
     m.attr("EXPL_MAX") = py::int_(static_cast<int>(EXPL_MAX));
     m.attr("NUM_ZAP") = py::int_(static_cast<int>(NUM_ZAP));
@@ -167,6 +443,107 @@ PYBIND11_MODULE(helper, m)
         },
         py::return_value_policy::reference);
 
+    m.def(
+        "decode_into",
+        [](py::buffer buf, py::dict out) {
+            py::buffer_info info = buf.request();
+            if (info.ndim != 1 || info.itemsize != 1)
+                throw py::value_error("expected a buffer of bytes");
+
+            std::vector<py::object> arrays;
+            const std::vector<py::ssize_t> map = { NLE_MAP_ROWS,
+                                                   NLE_MAP_COLS };
+            decode_targets t;
+            t.glyphs = decode_target<int16_t>(out, "glyphs", map, arrays);
+            t.chars = decode_target<uint8_t>(out, "chars", map, arrays);
+            t.colors = decode_target<uint8_t>(out, "colors", map, arrays);
+            t.specials = decode_target<uint8_t>(out, "specials", map, arrays);
+            t.glyphs_crop = decode_target<int16_t>(
+                out, "glyphs_crop", { -1, -1 }, arrays, &t.glyphs_crop_size);
+            t.blstats = decode_target<int32_t>(
+                out, "blstats", { NLE_BLSTATS_SIZE }, arrays);
+            t.message = decode_target<uint8_t>(
+                out, "message", { NLE_MESSAGE_SIZE }, arrays);
+            t.inv_glyphs = decode_target<int16_t>(
+                out, "inv_glyphs", { NLE_INVENTORY_SIZE }, arrays);
+            t.inv_strs = decode_target<uint8_t>(
+                out, "inv_strs",
+                { NLE_INVENTORY_SIZE, NLE_INVENTORY_STR_LENGTH }, arrays);
+            t.inv_letters = decode_target<uint8_t>(
+                out, "inv_letters", { NLE_INVENTORY_SIZE }, arrays);
+            t.inv_oclasses = decode_target<uint8_t>(
+                out, "inv_oclasses", { NLE_INVENTORY_SIZE }, arrays);
+
+            bool ok;
+            {
+                py::gil_scoped_release release;
+                auto data = static_cast<const uint8_t *>(info.ptr);
+                flatbuffers::Verifier verifier(data, info.size);
+                ok = nle::fbs::VerifyMessageBuffer(verifier);
+                if (ok)
+                    decode(nle::fbs::GetMessage(data), t);
+            }
+            if (!ok)
+                throw py::value_error("not a Message flatbuffer");
+        },
+        py::arg("buf"), py::arg("out"),
+        "Decodes the Message flatbuffer in buf into the arrays in out.\n\n"
+        "out maps names of nle_obs fields (glyphs, chars, colors, specials,\n"
+        "blstats, message, inv_glyphs, inv_strs, inv_letters, inv_oclasses)\n"
+        "to arrays of their shape and dtype, see include/nleobs.h, and\n"
+        "glyphs_crop to an int16 array of the (rows, cols) of the crop the\n"
+        "game was started with, see NLE_GLYPHS_CROP. Only the\n"
+        "fields in out are decoded, without holding the GIL. Parts missing\n"
+        "from the Message are zeroed, or padded as in nle_obs.");
+
+    m.def(
+        "decompose_glyphs",
+        [](py::array_t<int16_t, py::array::c_style | py::array::forcecast>
+               glyphs,
+           bool classes) {
+            std::vector<py::ssize_t> shape(glyphs.shape(),
+                                           glyphs.shape() + glyphs.ndim());
+            py::array_t<uint8_t> groups(shape);
+            py::array_t<int16_t> ids(shape);
+            py::array_t<uint8_t> mlets, oc_classes;
+            if (classes) {
+                mlets = py::array_t<uint8_t>(shape);
+                oc_classes = py::array_t<uint8_t>(shape);
+            }
+
+            const int16_t *in = glyphs.data();
+            uint8_t *group = groups.mutable_data();
+            int16_t *id = ids.mutable_data();
+            uint8_t *mlet = classes ? mlets.mutable_data() : nullptr;
+            uint8_t *oc_class = classes ? oc_classes.mutable_data() : nullptr;
+            py::ssize_t size = glyphs.size();
+            {
+                py::gil_scoped_release release;
+                for (py::ssize_t i = 0; i < size; ++i) {
+                    unsigned glyph = static_cast<uint16_t>(in[i]);
+                    const glyph_parts &p =
+                        glyph_table[glyph < MAX_GLYPH ? glyph : MAX_GLYPH];
+                    group[i] = p.group;
+                    id[i] = p.id;
+                    if (classes) {
+                        mlet[i] = p.mlet;
+                        oc_class[i] = p.oc_class;
+                    }
+                }
+            }
+            if (classes)
+                return py::make_tuple(groups, ids, mlets, oc_classes);
+            return py::make_tuple(groups, ids);
+        },
+        py::arg("glyphs"), py::arg("classes") = false,
+        "Splits glyphs into (groups, ids), arrays of the shape of glyphs.\n\n"
+        "groups are the GLYPH_GROUP_* of the glyphs, as uint8, and ids\n"
+        "their int16 offsets in their groups, e.g. the monster of a pet\n"
+        "glyph. Anything that isn't a glyph, such as NO_GLYPH, is in\n"
+        "GLYPH_GROUP_NONE with id 0. With classes, the tuple also has uint8\n"
+        "arrays of the mlet of the monster and the oc_class of the object\n"
+        "each glyph shows, or MAXMCLASSES and MAXOCLASSES if none.");
+
     m.def(
         "mlet_to_class_sym",
         [](char let) -> const class_sym * { return &def_monsyms[let]; },
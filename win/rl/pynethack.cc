@@ -0,0 +1,515 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "nledl.h"
+#include "nleshm.h"
+#include "threadpool.h"
+
+namespace py = pybind11;
+
+/*
+ * Runs NetHack inside the Python process via libnethack.so (see nle.h).
+ * Each Nethack object plays in its own copy of the library (see nledl.h),
+ * so any number of them can run side by side.
+ */
+class Nethack
+{
+  public:
+    Nethack(std::string dlpath, std::string hackdir, std::string options,
+            std::string playername, bool diskless)
+        : obs_(), hackdir_(std::move(hackdir)), options_(std::move(options)),
+          playername_(std::move(playername)), diskless_(diskless)
+    {
+        nle_ = nledl_open(dlpath.c_str());
+        if (!nle_)
+            throw std::bad_alloc();
+    }
+
+    ~Nethack()
+    {
+        close();
+        nledl_close(nle_);
+    }
+
+    void
+    reset(py::object ttyrec, unsigned long core, unsigned long disp)
+    {
+        close();
+
+        if (!ttyrec.is_none()) {
+            std::string filename = py::str(ttyrec);
+            ttyrec_ = fopen(filename.c_str(), "wb");
+            if (!ttyrec_)
+                throw std::runtime_error("Couldn't open " + filename);
+        }
+
+        nle_settings settings = { hackdir_.c_str(), options_.c_str(),
+                                  playername_.c_str(),
+                                  { core, disp },
+                                  diskless_ };
+        int error;
+        {
+            py::gil_scoped_release release;
+            error = nledl_start(nle_, &settings, &obs_, ttyrec_);
+        }
+        if (error)
+            throw std::runtime_error(nledl_error(nle_));
+        running_ = true;
+    }
+
+    bool
+    step(int action)
+    {
+        if (!running_)
+            throw std::runtime_error("step() called before reset()");
+        obs_.action = action;
+        {
+            py::gil_scoped_release release;
+            nledl_step(nle_, &obs_);
+        }
+        return obs_.done;
+    }
+
+    py::bytes
+    message()
+    {
+        size_t size = 0;
+        const void *buf = nledl_get_message(nle_, &size);
+        return py::bytes(static_cast<const char *>(buf), buf ? size : 0);
+    }
+
+    int
+    check_glyphmap()
+    {
+        if (!running_)
+            throw std::runtime_error(
+                "check_glyphmap() called before reset()");
+        return nledl_check_glyphmap(nle_);
+    }
+
+    void
+    close()
+    {
+        nledl_end(nle_);
+        running_ = false;
+        if (ttyrec_) {
+            fclose(ttyrec_);
+            ttyrec_ = nullptr;
+        }
+    }
+
+    bool
+    done() const
+    {
+        return obs_.done;
+    }
+
+    bool
+    in_moveloop() const
+    {
+        return obs_.in_moveloop;
+    }
+
+    bool
+    xwaitforspace() const
+    {
+        return obs_.xwaitforspace;
+    }
+
+    /* Arrays are views of obs_ and change with every step(). */
+    template <typename T, typename A>
+    py::array_t<T>
+    view(A &array, std::vector<ssize_t> shape)
+    {
+        return py::array_t<T>(shape, reinterpret_cast<T *>(&array),
+                              py::cast(this));
+    }
+
+    nle_obs obs_;
+
+  private:
+    std::string hackdir_;
+    std::string options_;
+    std::string playername_;
+    bool diskless_;
+
+    nledl_ctx *nle_;
+    bool running_ = false;
+    FILE *ttyrec_ = nullptr;
+};
+
+/* The writable, C-contiguous T array of the given shape in obj, or null if
+   obj is None. */
+template <typename T>
+T *
+output_array(py::object obj, const std::vector<ssize_t> &shape,
+             const char *name)
+{
+    using array = py::array_t<T, py::array::c_style>;
+
+    if (obj.is_none())
+        return nullptr;
+    if (!py::isinstance<array>(obj))
+        throw py::type_error(std::string(name) + " must be a C-contiguous "
+                             + py::str(py::dtype::of<T>()).cast<std::string>()
+                             + " array");
+    array arr = py::reinterpret_borrow<array>(obj);
+    if ((size_t) arr.ndim() != shape.size()
+        || !std::equal(shape.begin(), shape.end(), arr.shape()))
+        throw py::value_error(std::string(name) + " has the wrong shape");
+    return arr.mutable_data();
+}
+
+/*
+ * N games stepped as one batch on a thread pool.  Observations go straight
+ * into caller-provided arrays with a leading dimension of N.  A game that
+ * ends is started again at once: done[i] is then set and row i holds the
+ * first observation of the next episode.  Game i plays its first episode
+ * with the seeds given to reset() and each later one with seeds N more,
+ * so a batch replays exactly; seeds of 0 let NetHack pick them.
+ */
+class VectorNethack
+{
+  public:
+    VectorNethack(std::string dlpath, std::vector<std::string> hackdirs,
+                  std::string options, std::string playername,
+                  int num_threads, bool diskless)
+        : hackdirs_(std::move(hackdirs)), options_(std::move(options)),
+          playername_(std::move(playername)), diskless_(diskless),
+          obs_(hackdirs_.size()), seeds_(hackdirs_.size()),
+          errors_(hackdirs_.size()),
+          pool_(num_threads > 0
+                    ? num_threads
+                    : std::max(1, (int) std::thread::hardware_concurrency()))
+    {
+        for (size_t i = 0; i < hackdirs_.size(); ++i) {
+            nledl_ctx *ctx = nledl_open(dlpath.c_str());
+            if (!ctx) {
+                close();
+                throw std::bad_alloc();
+            }
+            games_.push_back(ctx);
+        }
+    }
+
+    ~VectorNethack()
+    {
+        close();
+    }
+
+    void
+    reset(py::object glyphs, py::object blstats, py::object message,
+          py::object core_seeds, py::object disp_seeds)
+    {
+        Outputs out = outputs(glyphs, blstats, message, py::none());
+        set_seeds(0, core_seeds, "core_seeds");
+        set_seeds(1, disp_seeds, "disp_seeds");
+        run([&](size_t i) {
+            start(i);
+            write(out, i, false);
+        });
+        running_ = true;
+    }
+
+    void
+    step(py::array_t<int, py::array::c_style | py::array::forcecast> actions,
+         py::object glyphs, py::object blstats, py::object message,
+         py::object done)
+    {
+        if (!running_)
+            throw std::runtime_error("step() called before reset()");
+        if (actions.ndim() != 1 || (size_t) actions.shape(0) != size())
+            throw py::value_error("Expected " + std::to_string(size())
+                                  + " actions");
+
+        const int *action = actions.data();
+        Outputs out = outputs(glyphs, blstats, message, done);
+        run([&](size_t i) {
+            obs_[i].action = action[i];
+            nledl_step(games_[i], &obs_[i]);
+            bool ended = obs_[i].done;
+            if (ended) {
+                for (unsigned long &seed : seeds_[i])
+                    if (seed)
+                        seed += size();
+                start(i);
+            }
+            write(out, i, ended);
+        });
+    }
+
+    void
+    close()
+    {
+        for (nledl_ctx *ctx : games_)
+            nledl_close(ctx);
+        games_.clear();
+        running_ = false;
+    }
+
+    size_t
+    size() const
+    {
+        return hackdirs_.size();
+    }
+
+  private:
+    struct Outputs {
+        int16_t *glyphs;
+        int32_t *blstats;
+        uint8_t *message;
+        bool *done;
+    };
+
+    Outputs
+    outputs(py::object glyphs, py::object blstats, py::object message,
+            py::object done)
+    {
+        ssize_t n = size();
+        return { output_array<int16_t>(glyphs,
+                                       { n, NLE_MAP_ROWS, NLE_MAP_COLS },
+                                       "glyphs"),
+                 output_array<int32_t>(blstats, { n, NLE_BLSTATS_SIZE },
+                                       "blstats"),
+                 output_array<uint8_t>(message, { n, NLE_MESSAGE_SIZE },
+                                       "message"),
+                 output_array<bool>(done, { n }, "done") };
+    }
+
+    /* Sets seeds k (0 core, 1 disp) of every game; None sets them to 0. */
+    void
+    set_seeds(int k, py::object seeds, const char *name)
+    {
+        if (seeds.is_none()) {
+            for (auto &game_seeds : seeds_)
+                game_seeds[k] = 0;
+            return;
+        }
+        auto values = seeds.cast<std::vector<unsigned long> >();
+        if (values.size() != size())
+            throw py::value_error("Expected " + std::to_string(size()) + " "
+                                  + name);
+        for (size_t i = 0; i < size(); ++i)
+            seeds_[i][k] = values[i];
+    }
+
+    /* Runs fn for every game with the GIL released; fn must not throw. */
+    void
+    run(const std::function<void(size_t)> &fn)
+    {
+        if (games_.size() != size())
+            throw std::runtime_error("VectorNethack is closed");
+        for (std::string &error : errors_)
+            error.clear();
+        {
+            py::gil_scoped_release release;
+            pool_.run(size(), fn);
+        }
+        for (const std::string &error : errors_)
+            if (!error.empty())
+                throw std::runtime_error(error);
+    }
+
+    /* Starts game i and skips the intro, like NLE.reset() does. */
+    void
+    start(size_t i)
+    {
+        nle_settings settings = { hackdirs_[i].c_str(), options_.c_str(),
+                                  playername_.c_str(),
+                                  { seeds_[i][0], seeds_[i][1] },
+                                  diskless_ };
+        nle_obs &obs = obs_[i];
+
+        if (nledl_start(games_[i], &settings, &obs, nullptr)) {
+            errors_[i] = nledl_error(games_[i]);
+            return;
+        }
+        while (!obs.in_moveloop && !obs.done) {
+            obs.action = ' ';
+            nledl_step(games_[i], &obs);
+        }
+        if (obs.done)
+            errors_[i] = "NetHack ended before the first move";
+    }
+
+    void
+    write(const Outputs &out, size_t i, bool ended)
+    {
+        const nle_obs &obs = obs_[i];
+
+        if (out.glyphs)
+            memcpy(out.glyphs + i * NLE_MAP_ROWS * NLE_MAP_COLS, obs.glyphs,
+                   sizeof(obs.glyphs));
+        if (out.blstats)
+            memcpy(out.blstats + i * NLE_BLSTATS_SIZE, obs.blstats,
+                   sizeof(obs.blstats));
+        if (out.message)
+            memcpy(out.message + i * NLE_MESSAGE_SIZE, obs.message,
+                   sizeof(obs.message));
+        if (out.done)
+            out.done[i] = ended;
+    }
+
+    std::vector<std::string> hackdirs_;
+    std::string options_;
+    std::string playername_;
+    bool diskless_;
+
+    std::vector<nledl_ctx *> games_;
+    std::vector<nle_obs> obs_;
+    std::vector<std::array<unsigned long, 2> > seeds_; /* core, disp */
+    std::vector<std::string> errors_;
+    bool running_ = false;
+
+    nle::ThreadPool pool_;
+};
+
+PYBIND11_MODULE(_pynethack, m)
+{
+    m.doc() = "NetHack running in-process via libnethack.so";
+
+    m.attr("NLE_MAP_ROWS") = py::int_(NLE_MAP_ROWS);
+    m.attr("NLE_MAP_COLS") = py::int_(NLE_MAP_COLS);
+    m.attr("NLE_CROP_SIZE") = py::int_(NLE_CROP_SIZE);
+    m.attr("NLE_BLSTATS_SIZE") = py::int_(NLE_BLSTATS_SIZE);
+    m.attr("NLE_MESSAGE_SIZE") = py::int_(NLE_MESSAGE_SIZE);
+    m.attr("NLE_INVENTORY_SIZE") = py::int_(NLE_INVENTORY_SIZE);
+    m.attr("NLE_INVENTORY_STR_LENGTH") = py::int_(NLE_INVENTORY_STR_LENGTH);
+
+    /* Layout of the process backend's shared memory, see nleshm.h. */
+    m.attr("NLE_SHM_SIZE") = py::int_(sizeof(nle_shm));
+    m.attr("NLE_SHM_SLOTS") = py::int_(NLE_SHM_SLOTS);
+    m.attr("NLE_SHM_SEQ_OFFSET") = py::int_(offsetof(nle_shm, seq));
+    m.attr("NLE_SHM_SLOT_OFFSET") = py::int_(offsetof(nle_shm, slot));
+    m.attr("NLE_SHM_SLOT_SIZE") = py::int_(sizeof(nle_shm_slot));
+    m.attr("NLE_SHM_MESSAGE_SIZE_OFFSET") =
+        py::int_(offsetof(nle_shm_slot, message_size));
+    m.attr("NLE_SHM_MESSAGE_OFFSET") =
+        py::int_(offsetof(nle_shm_slot, message));
+
+    py::dict obs_offsets;
+    obs_offsets["done"] = offsetof(nle_obs, done);
+    obs_offsets["in_moveloop"] = offsetof(nle_obs, in_moveloop);
+    obs_offsets["xwaitforspace"] = offsetof(nle_obs, xwaitforspace);
+    obs_offsets["glyphs"] = offsetof(nle_obs, glyphs);
+    obs_offsets["chars"] = offsetof(nle_obs, chars);
+    obs_offsets["colors"] = offsetof(nle_obs, colors);
+    obs_offsets["specials"] = offsetof(nle_obs, specials);
+    obs_offsets["glyphs_crop"] = offsetof(nle_obs, glyphs_crop);
+    obs_offsets["blstats"] = offsetof(nle_obs, blstats);
+    obs_offsets["message"] = offsetof(nle_obs, message);
+    obs_offsets["inv_glyphs"] = offsetof(nle_obs, inv_glyphs);
+    obs_offsets["inv_strs"] = offsetof(nle_obs, inv_strs);
+    obs_offsets["inv_letters"] = offsetof(nle_obs, inv_letters);
+    obs_offsets["inv_oclasses"] = offsetof(nle_obs, inv_oclasses);
+    m.attr("NLE_OBS_OFFSETS") = obs_offsets;
+
+    py::class_<Nethack>(m, "Nethack")
+        .def(py::init<std::string, std::string, std::string, std::string,
+                      bool>(),
+             py::arg("dlpath"), py::arg("hackdir"), py::arg("options"),
+             py::arg("playername"), py::arg("diskless") = false)
+        .def("reset", &Nethack::reset, py::arg("ttyrec") = py::none(),
+             py::arg("core_seed") = 0, py::arg("disp_seed") = 0)
+        .def("step", &Nethack::step, py::arg("action"))
+        .def("message", &Nethack::message)
+        .def("_check_glyphmap", &Nethack::check_glyphmap)
+        .def("close", &Nethack::close)
+        .def_property_readonly("done", &Nethack::done)
+        .def_property_readonly("in_moveloop", &Nethack::in_moveloop)
+        .def_property_readonly("xwaitforspace", &Nethack::xwaitforspace)
+        .def_property_readonly("glyphs",
+                               [](Nethack &self) {
+                                   return self.view<int16_t>(
+                                       self.obs_.glyphs,
+                                       { NLE_MAP_ROWS, NLE_MAP_COLS });
+                               })
+        .def_property_readonly("chars",
+                               [](Nethack &self) {
+                                   return self.view<uint8_t>(
+                                       self.obs_.chars,
+                                       { NLE_MAP_ROWS, NLE_MAP_COLS });
+                               })
+        .def_property_readonly("colors",
+                               [](Nethack &self) {
+                                   return self.view<uint8_t>(
+                                       self.obs_.colors,
+                                       { NLE_MAP_ROWS, NLE_MAP_COLS });
+                               })
+        .def_property_readonly("specials",
+                               [](Nethack &self) {
+                                   return self.view<uint8_t>(
+                                       self.obs_.specials,
+                                       { NLE_MAP_ROWS, NLE_MAP_COLS });
+                               })
+        .def_property_readonly("glyphs_crop",
+                               [](Nethack &self) {
+                                   return self.view<int16_t>(
+                                       self.obs_.glyphs_crop,
+                                       { NLE_CROP_SIZE });
+                               })
+        .def_property_readonly("blstats",
+                               [](Nethack &self) {
+                                   return self.view<int32_t>(
+                                       self.obs_.blstats,
+                                       { NLE_BLSTATS_SIZE });
+                               })
+        .def_property_readonly("message_chars",
+                               [](Nethack &self) {
+                                   return self.view<uint8_t>(
+                                       self.obs_.message,
+                                       { NLE_MESSAGE_SIZE });
+                               })
+        .def_property_readonly("inv_glyphs",
+                               [](Nethack &self) {
+                                   return self.view<int16_t>(
+                                       self.obs_.inv_glyphs,
+                                       { NLE_INVENTORY_SIZE });
+                               })
+        .def_property_readonly("inv_strs",
+                               [](Nethack &self) {
+                                   return self.view<uint8_t>(
+                                       self.obs_.inv_strs,
+                                       { NLE_INVENTORY_SIZE,
+                                         NLE_INVENTORY_STR_LENGTH });
+                               })
+        .def_property_readonly("inv_letters",
+                               [](Nethack &self) {
+                                   return self.view<uint8_t>(
+                                       self.obs_.inv_letters,
+                                       { NLE_INVENTORY_SIZE });
+                               })
+        .def_property_readonly("inv_oclasses", [](Nethack &self) {
+            return self.view<uint8_t>(self.obs_.inv_oclasses,
+                                      { NLE_INVENTORY_SIZE });
+        });
+
+    py::class_<VectorNethack>(m, "VectorNethack")
+        .def(py::init<std::string, std::vector<std::string>, std::string,
+                      std::string, int, bool>(),
+             py::arg("dlpath"), py::arg("hackdirs"), py::arg("options"),
+             py::arg("playername"), py::arg("num_threads") = 0,
+             py::arg("diskless") = false)
+        .def("reset", &VectorNethack::reset, py::arg("glyphs") = py::none(),
+             py::arg("blstats") = py::none(), py::arg("message") = py::none(),
+             py::arg("core_seeds") = py::none(),
+             py::arg("disp_seeds") = py::none())
+        .def("step", &VectorNethack::step, py::arg("actions"),
+             py::arg("glyphs") = py::none(), py::arg("blstats") = py::none(),
+             py::arg("message") = py::none(), py::arg("done") = py::none())
+        .def("close", &VectorNethack::close)
+        .def("__len__", &VectorNethack::size);
+}
@@ -0,0 +1,114 @@
+/* Copyright (c) Facebook, Inc. and its affiliates. */
+#ifndef NLE_THREADPOOL_H
+#define NLE_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nle
+{
+/*
+ * Fixed set of threads running batches of independent tasks.  run(n, fn)
+ * calls fn(0), ..., fn(n - 1) and returns once all of them are done.
+ * Threads (the caller included) grab the next task index off a shared
+ * counter, so a thread stuck on a slow task doesn't hold up the others.
+ * fn must not throw.
+ */
+class ThreadPool
+{
+  public:
+    /* Runs batches on num_threads threads, counting the caller. */
+    explicit ThreadPool(int num_threads)
+    {
+        for (int i = 1; i < num_threads; ++i)
+            threads_.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (std::thread &t : threads_)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t
+    size() const
+    {
+        return threads_.size() + 1;
+    }
+
+    void
+    run(size_t n, const std::function<void(size_t)> &fn)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        fn_ = &fn;
+        n_ = n;
+        next_ = 0;
+        busy_ = threads_.size();
+        ++batch_;
+        lock.unlock();
+        start_cv_.notify_all();
+
+        drain();
+
+        lock.lock();
+        done_cv_.wait(lock, [this] { return busy_ == 0; });
+        fn_ = nullptr;
+    }
+
+  private:
+    void
+    drain()
+    {
+        size_t i;
+        while ((i = next_.fetch_add(1)) < n_)
+            (*fn_)(i);
+    }
+
+    void
+    work()
+    {
+        uint64_t batch = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            start_cv_.wait(lock, [&] { return stop_ || batch_ != batch; });
+            if (stop_)
+                return;
+            batch = batch_;
+            lock.unlock();
+            drain();
+            lock.lock();
+            if (--busy_ == 0)
+                done_cv_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    bool stop_ = false;
+    uint64_t batch_ = 0;
+    size_t busy_ = 0;
+
+    const std::function<void(size_t)> *fn_ = nullptr;
+    size_t n_ = 0;
+    std::atomic<size_t> next_{ 0 };
+};
+
+} // namespace nle
+
+#endif // NLE_THREADPOOL_H
@@ -1,25 +1,41 @@
 /* Copyright (c) Facebook, Inc. and its affiliates. */
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <deque>
+#include <errno.h>
+#include <fcntl.h>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <stdio.h>
 #include <string>
+#include <termios.h>
+#include <thread>
 #include <unistd.h>
 
 #include "message_generated.h"
 #include <flatbuffers/flatbuffers.h>
+#ifndef NLE_LIB
+#include <poll.h>
+#include <sys/mman.h>
 #include <zmq.hpp>
+#endif
 
 extern "C" {
 #include "hack.h"
+#include "dlb.h"
 }
 
 extern "C" {
 #include "wintty.h"
 }
 
+#include "func_tab.h"
+#include "nleobs.h"
+#ifndef NLE_LIB
+#include "nleshm.h"
+#endif
+
 #define USE_DEBUG_API 0
 
 #if USE_DEBUG_API
@@ -50,27 +66,163 @@ extern bool xwaitingforspace;
 #undef yn
 
 extern unsigned long nle_seeds[];
+extern char nle_xlogentry[];
+
+static_assert(NLE_MAP_ROWS == ROWNO, "nleobs.h doesn't match hack.h");
+static_assert(NLE_MAP_COLS == COLNO - 1, "nleobs.h doesn't match hack.h");
 
 namespace nethack_rl
 {
-std::deque<std::string> win_proc_calls;
+/* The window procs being run, outermost first.  Plain data, not a
+   container that allocates when constructed: nledl resets our globals as a
+   block for the next game, which would restore its first game's pointers. */
+const int MAX_WIN_PROC_CALLS = 16;
+struct win_proc_stack {
+    const char *calls[MAX_WIN_PROC_CALLS];
+    int depth; /* calls past MAX_WIN_PROC_CALLS are counted, not kept */
+} win_proc_calls;
+
+/*
+ * Headless mode, set by NLE_HEADLESS: the rl port does all windowing itself
+ * (menus, prompts, --More--) and never calls into win/tty, so nothing is
+ * drawn on the terminal. Keys come straight from stdin (or nle_step()).
+ */
+static bool headless = false;
+
+/* Lines per menu page; tty's on the 24 line terminal NLE gives it. */
+const int HEADLESS_MENU_PAGE = 23;
+
+/* Initial size of a message builder, enough for a full Message with a
+   map_delta keyframe so that it doesn't need to grow. */
+const size_t MESSAGE_BUILDER_SIZE = 1 << 16;
+
+#ifdef NLE_LIB
+/* Owns the buffer passed to nle_set_message(); outlives NetHackRL so that
+   the final not_running message stays valid after exit_nhwindows().  Freed
+   by nle_rl_free(), as nledl may reset our globals for the next game. */
+std::unique_ptr<flatbuffers::FlatBufferBuilder> message_builder;
+#endif
+
+/* Optional parts of the Message's Observation, see NLE_OBSERVATION_KEYS. */
+enum observation_key {
+    OBS_GLYPHS = 1 << 0,
+    OBS_CHARS = 1 << 1,
+    OBS_COLORS = 1 << 2,
+    OBS_SPECIALS = 1 << 3,
+    OBS_STATUS = 1 << 4,
+    OBS_INVENTORY = 1 << 5,
+    OBS_MAP_DELTA = 1 << 6,
+    OBS_GLYPHS_CROP = 1 << 7,
+    OBS_ALL = (1 << 8) - 1
+};
+
+/* Messages between two map_delta keyframes. */
+const int MAP_KEYFRAME_INTERVAL = 100;
+
+/* NLE_OBSERVATION_KEYS is a comma-separated list of the keys above (in
+   lower case, without OBS_); unset means all of them. */
+static unsigned
+parse_observation_keys(const char *keys)
+{
+    /* Plain data, not a std::map: nledl resets our globals between games,
+       and function-local statics that need constructing wouldn't survive
+       that (see nledl.h). */
+    static const struct {
+        const char *name;
+        unsigned key;
+    } names[] = {
+        { "glyphs", OBS_GLYPHS },     { "chars", OBS_CHARS },
+        { "colors", OBS_COLORS },     { "specials", OBS_SPECIALS },
+        { "status", OBS_STATUS },     { "inventory", OBS_INVENTORY },
+        { "map_delta", OBS_MAP_DELTA }, { "glyphs_crop", OBS_GLYPHS_CROP },
+    };
+
+    if (!keys)
+        return OBS_ALL;
+
+    unsigned result = 0;
+    std::string rest(keys);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string key = rest.substr(0, comma);
+        rest = comma == std::string::npos ? "" : rest.substr(comma + 1);
+        if (key.empty())
+            continue;
+        unsigned found = 0;
+        for (const auto &name : names)
+            if (key == name.name)
+                found = name.key;
+        if (!found)
+            panic("Unknown NLE_OBSERVATION_KEYS entry '%s'", key.c_str());
+        result |= found;
+    }
+    return result;
+}
+
+/* NLE_GLYPHS_CROP is "rows,cols" or "rows,cols,fill": the size of the
+   glyphs_crop window around the hero, and the glyph for its cells off the
+   map. Unset means 9 by 9, filled with solid rock. */
+static void
+parse_glyphs_crop(const char *spec, int *rows, int *cols, int *fill)
+{
+    *rows = *cols = 9;
+    *fill = cmap_to_glyph(S_stone);
+    if (!spec)
+        return;
+
+    int n = sscanf(spec, "%d,%d,%d", rows, cols, fill);
+    if (n < 2 || *rows <= 0 || *cols <= 0 || *rows * *cols > NLE_CROP_SIZE
+        || *fill < 0 || *fill > MAX_GLYPH)
+        panic("Bad NLE_GLYPHS_CROP '%s'", spec);
+}
+
+#ifndef NLE_LIB
+/* One unbuffered key from fd, EOF at its end. */
+static int
+read_key(int fd)
+{
+    unsigned char ch;
+    ssize_t n;
+
+    while ((n = read(fd, &ch, 1)) < 0 && errno == EINTR)
+        ;
+    return (n == 1) ? ch : EOF;
+}
+#endif
+
+/* As tty_nhgetch(), minus the terminal. */
+static int
+headless_nhgetch()
+{
+    int c;
+
+    if (program_state.done_hup)
+        return '\033';
+#ifdef NLE_LIB
+    c = nle_getch();
+#else
+    c = read_key(fileno(stdin));
+#endif
+    return (c == 0 || c == EOF) ? '\033' : c; /* nethack expects neither */
+}
 
 class ScopedStack
 {
   public:
-    ScopedStack(std::deque<std::string> &deque, std::string &&s)
-        : deque_(deque)
+    ScopedStack(win_proc_stack &stack, const char *s) : stack_(stack)
     {
-        deque_.push_back(s);
+        if (stack_.depth < MAX_WIN_PROC_CALLS)
+            stack_.calls[stack_.depth] = s;
+        ++stack_.depth;
     }
 
     ~ScopedStack()
     {
-        deque_.pop_back();
+        --stack_.depth;
     }
 
   private:
-    std::deque<std::string> &deque_;
+    win_proc_stack &stack_;
 };
 
 class NetHackRL
@@ -163,15 +315,39 @@ class NetHackRL
 
     std::array<int16_t, (COLNO - 1) * ROWNO> glyphs_;
 
+    std::array<int, NLE_BLSTATS_SIZE> blstats_;
+
     /* Output of mapglyph */
     std::array<uint8_t, (COLNO - 1) * ROWNO> chars_;
     std::array<uint8_t, (COLNO - 1) * ROWNO> colors_;
     std::array<uint8_t, (COLNO - 1) * ROWNO> specials_;
 
+    /* Size and fill glyph of glyphs_crop, see NLE_GLYPHS_CROP. */
+    int crop_rows_, crop_cols_, crop_fill_;
+    std::array<int16_t, NLE_CROP_SIZE> glyphs_crop_;
+    void fill_glyphs_crop(int16_t *crop);
+
     void store_glyph(XCHAR_P x, XCHAR_P y, int glyph);
     void store_mapped_glyph(int ch, int color, int special, XCHAR_P x,
                             XCHAR_P y);
 
+    /* Since the map was cleared, its glyphs are only stored; remap_map()
+       maps them all in one pass before the next observation.  Cells not
+       printed since stay blank. */
+    bool remap_;
+    std::array<bool, (COLNO - 1) * ROWNO> printed_;
+    void remap_map();
+
+    /* Cells changed since the last map_delta, if that was requested. */
+    std::array<bool, (COLNO - 1) * ROWNO> dirty_;
+    std::vector<uint16_t> dirty_cells_;
+    std::vector<nle::fbs::MapCell> map_cells_;
+    int since_keyframe_;
+
+    void mark_dirty(size_t offset);
+    flatbuffers::Offset<nle::fbs::MapDelta>
+    build_map_delta(flatbuffers::FlatBufferBuilder &builder);
+
     int getch_method();
 
     std::array<std::string, MAXBLSTATS> status_;
@@ -196,23 +372,98 @@ class NetHackRL
     void display_nhwindow_method(winid wid, BOOLEAN_P block);
     void destroy_nhwindow_method(winid wid);
 
-    zmq::message_t observation_message();
+    /* Headless mode, see above. */
+    std::deque<std::string> msg_history_;
+    size_t msg_history_next_ = 0; /* for rl_getmsghistory() */
+    size_t prev_message_ = 0;     /* for rl_doprev_message() */
+    bool message_unseen_ = false; /* put after the last getch_method() */
+
+    void headless_player_selection();
+    winid headless_create_nhwindow(int type);
+    int headless_wait();
+    void headless_display_nhwindow(winid wid, BOOLEAN_P block);
+    void headless_end_menu(winid wid, const char *prompt);
+    int headless_select_menu(winid wid, int how, menu_item **menu_list);
+    char headless_yn_function(const char *question, const char *choices,
+                              char def);
+    void headless_getlin(const char *prompt, char *line);
+    int headless_get_ext_cmd();
+    int headless_doprev_message();
+    void headless_display_file(const char *filename, bool must_exist);
+    char *headless_getmsghistory(bool init);
+    void headless_putmsghistory(const char *msg);
+
+    void fill_blstats(int *blstats);
+    void fill_obs(nle_obs *obs);
+    void build_message(flatbuffers::FlatBufferBuilder &builder);
+
+    /* Offsets build_message() collects before it makes vectors of them;
+       kept so that their storage is reused from one message to the next. */
+    std::vector<flatbuffers::Offset<flatbuffers::String> > fb_strings_;
+    std::vector<flatbuffers::Offset<nle::fbs::MenuItem> > fb_items_;
+    std::vector<flatbuffers::Offset<nle::fbs::Window> > fb_windows_;
+    std::vector<flatbuffers::Offset<nle::fbs::InventoryItem> >
+        fb_inventory_;
+
+    unsigned observation_keys_;
+
+#ifndef NLE_LIB
+    /* Messages are built in two builders in turn, kept so that their
+       buffers needn't be allocated anew.  ZMQ sends straight from the
+       buffer and calls release_message() once done with it; a builder
+       isn't cleared for reuse before that. */
+    struct message_buffer {
+        flatbuffers::FlatBufferBuilder builder{ MESSAGE_BUILDER_SIZE };
+        std::atomic<bool> in_flight{ false };
+    };
+    std::array<message_buffer, 2> message_buffers_;
+    size_t next_message_buffer_ = 0;
+
+    message_buffer &next_message_buffer();
+    static void release_message(void *data, void *hint);
+    void send_message(message_buffer &buffer, bool done = false);
+
+    /* Shared-memory transport, see nleshm.h; ZMQ if NLE_SHM isn't set. */
+    nle_shm *shm_ = nullptr;
+    int shm_notify_ = -1;
+    int shm_action_ = -1; /* keys come from the pty if not set */
+    int shm_control_ = -1; /* NLE_CONTROL, see nle_control() in unixmain.c */
+
+    int action_nhgetch();
+    void control();
+    void connect();
 
     std::string socket_address_;
     zmq::context_t zmq_context_;
-    zmq::socket_t zmq_socket_;
+    std::unique_ptr<zmq::socket_t> zmq_socket_;
+#endif
 };
 
 std::unique_ptr<NetHackRL> NetHackRL::instance =
     std::unique_ptr<NetHackRL>(nullptr);
 
 NetHackRL::NetHackRL(int &argc, char **argv)
-    : glyphs_(), zmq_context_(1), zmq_socket_(zmq_context_, ZMQ_PUSH)
+    : glyphs_(), blstats_(), remap_(false), printed_(), dirty_(),
+      since_keyframe_(MAP_KEYFRAME_INTERVAL),
+      observation_keys_(
+          parse_observation_keys(nh_getenv("NLE_OBSERVATION_KEYS")))
+#ifndef NLE_LIB
+      ,
+      zmq_context_(1)
+#endif
 {
-    std::string hackdir(getcwd(0, 255));
-    socket_address_ =
-        "ipc://" + hackdir + "/" + std::to_string(getpid()) + ".nle.sock";
-    zmq_socket_.bind(socket_address_);
+#ifdef NLE_LIB
+    if (!message_builder)
+        message_builder.reset(
+            new flatbuffers::FlatBufferBuilder(MESSAGE_BUILDER_SIZE));
+#endif
+    parse_glyphs_crop(nh_getenv("NLE_GLYPHS_CROP"), &crop_rows_, &crop_cols_,
+                      &crop_fill_);
+#ifndef NLE_LIB
+    /* A zygote's games connect once they are forked off, see unixmain.c. */
+    if (!nh_getenv("NLE_ZYGOTE"))
+        connect();
+#endif
 
     // create base window
     // (done in tty_init_nhwindows before this NetHackRL object got created).
@@ -220,28 +471,243 @@ NetHackRL::NetHackRL(int &argc, char **argv)
     windows_.emplace_back(new rl_window({ NHW_BASE }));
 }
 
+#ifndef NLE_LIB
+void
+NetHackRL::connect()
+{
+    const char *shm_fd = nh_getenv("NLE_SHM");
+    const char *shm_notify = nh_getenv("NLE_SHM_NOTIFY");
+
+    if (shm_fd && shm_notify) {
+        int fd = atoi(shm_fd);
+        void *shm = mmap(0, sizeof(nle_shm), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+        int mmap_errno = errno;
+        close(fd);
+        if (shm == MAP_FAILED)
+            panic("Can't map NLE_SHM %s: %s", shm_fd, strerror(mmap_errno));
+        shm_ = static_cast<nle_shm *>(shm);
+        shm_->slots = NLE_SHM_SLOTS;
+        shm_->magic = NLE_SHM_MAGIC;
+        shm_notify_ = atoi(shm_notify);
+        if (const char *shm_action = nh_getenv("NLE_SHM_ACTION"))
+            shm_action_ = atoi(shm_action);
+        if (const char *shm_control = nh_getenv("NLE_CONTROL"))
+            shm_control_ = atoi(shm_control);
+    } else {
+        std::string hackdir(getcwd(0, 255));
+        socket_address_ = "ipc://" + hackdir + "/"
+                          + std::to_string(getpid()) + ".nle.sock";
+        zmq_socket_.reset(new zmq::socket_t(zmq_context_, ZMQ_PUSH));
+        zmq_socket_->bind(socket_address_);
+    }
+}
+#endif
+
 NetHackRL::~NetHackRL()
 {
-    flatbuffers::FlatBufferBuilder builder(1024);
-    auto fb_response =
-        nle::fbs::CreateMessage(builder, 0, 0, 0, 0, 0, 0, 0, true);
+#ifdef NLE_LIB
+    message_builder->Clear();
+    auto xlogfile = *nle_xlogentry
+                        ? message_builder->CreateString(nle_xlogentry)
+                        : 0;
+    auto fb_response = nle::fbs::CreateMessage(*message_builder, 0, 0, 0, 0,
+                                               0, 0, 0, true, xlogfile);
+    message_builder->Finish(fb_response);
+    nle_set_message(message_builder->GetBufferPointer(),
+                    message_builder->GetSize());
+#else
+    if (!shm_ && !zmq_socket_)
+        return; /* a zygote, nobody to tell */
+
+    message_buffer &buffer = next_message_buffer();
+    flatbuffers::FlatBufferBuilder &builder = buffer.builder;
+    auto xlogfile =
+        *nle_xlogentry ? builder.CreateString(nle_xlogentry) : 0;
+    auto fb_response = nle::fbs::CreateMessage(builder, 0, 0, 0, 0, 0, 0, 0,
+                                               true, xlogfile);
     builder.Finish(fb_response);
+    send_message(buffer, true);
+
+    if (shm_) {
+        close(shm_notify_);
+        if (shm_action_ >= 0)
+            close(shm_action_);
+        if (shm_control_ >= 0)
+            close(shm_control_);
+        munmap(shm_, sizeof(nle_shm));
+    } else {
+        zmq_socket_->unbind(socket_address_);
+    }
+#endif
+}
 
-    zmq::message_t reply(builder.GetSize());
-    memcpy(reply.data(), builder.GetBufferPointer(), builder.GetSize());
-    zmq_socket_.send(reply);
+#ifndef NLE_LIB
+NetHackRL::message_buffer &
+NetHackRL::next_message_buffer()
+{
+    message_buffer &buffer =
+        message_buffers_[next_message_buffer_++ % message_buffers_.size()];
+
+    /* The other side has answered the message sent from the other buffer
+       since, so ZMQ should be long done with this one. */
+    while (buffer.in_flight.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    buffer.builder.Clear();
+    return buffer;
+}
 
-    zmq_socket_.unbind(socket_address_);
+/* Called by ZMQ, from its I/O thread, once it has sent a message. */
+void
+NetHackRL::release_message(void *data, void *hint)
+{
+    (void) data;
+    static_cast<std::atomic<bool> *>(hint)->store(false,
+                                                  std::memory_order_release);
 }
 
-zmq::message_t
-NetHackRL::observation_message()
+void
+NetHackRL::send_message(message_buffer &buffer, bool done)
 {
-    // Assumes mutex is held.
-    flatbuffers::FlatBufferBuilder builder(1024);
+    flatbuffers::FlatBufferBuilder &builder = buffer.builder;
 
-    std::vector<flatbuffers::Offset<nle::fbs::Window> > windows_vector;
+    if (!shm_ && !zmq_socket_)
+        connect();
 
+    if (!shm_) {
+        buffer.in_flight.store(true, std::memory_order_relaxed);
+        zmq::message_t reply(builder.GetBufferPointer(), builder.GetSize(),
+                             release_message, &buffer.in_flight);
+        zmq_socket_->send(reply);
+        return;
+    }
+
+    uint64_t seq = shm_->seq;
+    nle_shm_slot &slot = shm_->slot[seq % NLE_SHM_SLOTS];
+
+    if (builder.GetSize() > sizeof(slot.message))
+        panic("Message of %lu bytes doesn't fit NLE_SHM",
+              (unsigned long) builder.GetSize());
+    fill_obs(&slot.obs);
+    slot.obs.done = done;
+    slot.message_size = builder.GetSize();
+    memcpy(slot.message, builder.GetBufferPointer(), builder.GetSize());
+    __atomic_store_n(&shm_->seq, seq + 1, __ATOMIC_RELEASE);
+
+    char c = 0;
+    while (write(shm_notify_, &c, 1) < 0 && errno == EINTR)
+        ;
+}
+#endif
+
+void
+NetHackRL::fill_obs(nle_obs *obs)
+{
+    static_assert(sizeof(obs->glyphs) == sizeof(glyphs_),
+                  "nle_obs.glyphs has the wrong size");
+    static_assert(sizeof(obs->chars) == sizeof(chars_),
+                  "nle_obs.chars has the wrong size");
+
+    remap_map();
+    obs->in_moveloop = program_state.in_moveloop;
+    obs->xwaitforspace = xwaitingforspace;
+    memcpy(obs->glyphs, glyphs_.data(), sizeof(obs->glyphs));
+    memcpy(obs->chars, chars_.data(), sizeof(obs->chars));
+    memcpy(obs->colors, colors_.data(), sizeof(obs->colors));
+    memcpy(obs->specials, specials_.data(), sizeof(obs->specials));
+    if (observation_keys_ & OBS_GLYPHS_CROP)
+        fill_glyphs_crop(obs->glyphs_crop);
+    memcpy(obs->blstats, blstats_.data(), sizeof(obs->blstats));
+
+    memset(obs->message, 0, sizeof(obs->message));
+    if (WIN_MESSAGE != WIN_ERR && WIN_MESSAGE < (winid) windows_.size()
+        && windows_[WIN_MESSAGE]) {
+        size_t offset = 0;
+        for (const std::string &str : windows_[WIN_MESSAGE]->strings) {
+            if (offset >= sizeof(obs->message))
+                break;
+            size_t size = str.size();
+            if (size > sizeof(obs->message) - offset - 1)
+                size = sizeof(obs->message) - offset - 1;
+            memcpy(&obs->message[offset], str.data(), size);
+            offset += size + 1;
+        }
+    }
+
+    memset(obs->inv_strs, 0, sizeof(obs->inv_strs));
+    memset(obs->inv_letters, 0, sizeof(obs->inv_letters));
+    size_t i = 0;
+    for (; i < inventory_.size() && i < NLE_INVENTORY_SIZE; ++i) {
+        const rl_inventory_item &item = inventory_[i];
+        obs->inv_glyphs[i] = item.glyph;
+        strncpy((char *) obs->inv_strs[i], item.str.c_str(),
+                NLE_INVENTORY_STR_LENGTH - 1);
+        obs->inv_letters[i] = item.letter;
+        obs->inv_oclasses[i] = item.object_class;
+    }
+    for (; i < NLE_INVENTORY_SIZE; ++i) {
+        obs->inv_glyphs[i] = NO_GLYPH;
+        obs->inv_oclasses[i] = MAXOCLASSES;
+    }
+}
+
+/* The crop_rows_ x crop_cols_ glyphs around the hero, who is in the middle
+   (or just below and right of it, for even sizes). */
+void
+NetHackRL::fill_glyphs_crop(int16_t *crop)
+{
+    int top = u.uy - crop_rows_ / 2, left = u.ux - 1 - crop_cols_ / 2;
+
+    for (int i = 0; i < crop_rows_; ++i) {
+        int y = top + i;
+        for (int j = 0; j < crop_cols_; ++j) {
+            int x = left + j;
+            *crop++ = (y >= 0 && y < ROWNO && x >= 0 && x < COLNO - 1)
+                          ? glyphs_[y * (COLNO - 1) + x]
+                          : crop_fill_;
+        }
+    }
+}
+
+void
+NetHackRL::fill_blstats(int *blstats)
+{
+    /* Cf. botl.c. */
+    int hitpoints = Upolyd ? u.mh : u.uhp;
+    if (hitpoints < 0)
+        hitpoints = 0;
+    int max_hitpoints = Upolyd ? u.mhmax : u.uhpmax;
+
+    blstats[NLE_BL_X] = u.ux - 1; /* x coordinate, 1 <= ux <= cols */
+    blstats[NLE_BL_Y] = u.uy;     /* y coordinate, 0 <= uy < rows */
+    blstats[NLE_BL_STR25] = ACURRSTR;
+    blstats[NLE_BL_STR125] = ACURR(A_STR);
+    blstats[NLE_BL_DEX] = ACURR(A_DEX);
+    blstats[NLE_BL_CON] = ACURR(A_CON);
+    blstats[NLE_BL_INT] = ACURR(A_INT);
+    blstats[NLE_BL_WIS] = ACURR(A_WIS);
+    blstats[NLE_BL_CHA] = ACURR(A_CHA);
+    blstats[NLE_BL_SCORE] = botl_score();
+    blstats[NLE_BL_HP] = min(hitpoints, 9999);
+    blstats[NLE_BL_HPMAX] = min(max_hitpoints, 9999);
+    blstats[NLE_BL_DEPTH] = depth(&u.uz);
+    blstats[NLE_BL_GOLD] = money_cnt(invent);
+    blstats[NLE_BL_ENE] = min(u.uen, 9999);
+    blstats[NLE_BL_ENEMAX] = min(u.uenmax, 9999);
+    blstats[NLE_BL_AC] = u.uac;
+    blstats[NLE_BL_HD] = Upolyd ? (int) mons[u.umonnum].mlevel : 0;
+    blstats[NLE_BL_XP] = u.ulevel;
+    blstats[NLE_BL_EXP] = u.uexp;
+    blstats[NLE_BL_TIME] = moves;
+    blstats[NLE_BL_HUNGER] = u.uhs;
+    blstats[NLE_BL_CAP] = near_capacity();
+}
+
+void
+NetHackRL::build_message(flatbuffers::FlatBufferBuilder &builder)
+{
+    remap_map();
+    fb_windows_.clear();
     for (const auto &rl_win : windows_) {
         if (!rl_win)
             continue;
@@ -253,30 +719,30 @@ NetHackRL::observation_message()
             flatbuffers::Vector<flatbuffers::Offset<nle::fbs::MenuItem> > >
             fb_items;
 
-        std::vector<flatbuffers::Offset<flatbuffers::String> > strings_vector;
+        fb_strings_.clear();
         for (const std::string &str : rl_win->strings) {
-            strings_vector.push_back(builder.CreateString(str));
+            fb_strings_.push_back(builder.CreateString(str));
         }
-        if (!strings_vector.empty()) {
-            fb_strings = builder.CreateVector(strings_vector);
+        if (!fb_strings_.empty()) {
+            fb_strings = builder.CreateVector(fb_strings_);
         }
 
-        std::vector<flatbuffers::Offset<nle::fbs::MenuItem> > items_vector;
+        fb_items_.clear();
         for (const rl_menu_item &item : rl_win->menu_items) {
             auto fb_str = builder.CreateString(item.str);
             auto fb_item = nle::fbs::CreateMenuItem(
                 builder, item.glyph, item.selector, item.gselector, fb_str,
                 item.selected);
-            items_vector.push_back(fb_item);
+            fb_items_.push_back(fb_item);
         }
-        if (!items_vector.empty()) {
-            fb_items = builder.CreateVector(items_vector);
+        if (!fb_items_.empty()) {
+            fb_items = builder.CreateVector(fb_items_);
         }
 
-        windows_vector.push_back(nle::fbs::CreateWindow(
+        fb_windows_.push_back(nle::fbs::CreateWindow(
             builder, rl_win->type, fb_items, fb_strings));
     }
-    auto fb_windows = builder.CreateVector(windows_vector);
+    auto fb_windows = builder.CreateVector(fb_windows_);
 
     auto fb_seeds = nle::fbs::Seeds(nle_seeds[0], nle_seeds[1]);
 
@@ -292,10 +758,7 @@ NetHackRL::observation_message()
         auto fb_response = nle::fbs::CreateMessage(
             builder, 0, 0, 0, fb_windows, 0, &fb_program_state, &fb_seeds);
         builder.Finish(fb_response);
-
-        zmq::message_t reply(builder.GetSize());
-        memcpy(reply.data(), builder.GetBufferPointer(), builder.GetSize());
-        return reply;
+        return;
     }
 
     // Condition
@@ -315,123 +778,101 @@ NetHackRL::observation_message()
         (condition_bits_ & BL_MASK_RIDE) == BL_MASK_RIDE);
 
     // Status
-    auto fb_status = nle::fbs::CreateStatus(
-        builder, builder.CreateString(status_[BL_TITLE]),
-        builder.CreateString(status_[BL_STR]),
-        builder.CreateString(status_[BL_DX]),
-        builder.CreateString(status_[BL_CO]),
-        builder.CreateString(status_[BL_IN]),
-        builder.CreateString(status_[BL_WI]),
-        builder.CreateString(status_[BL_CH]), /* 1..6 */
-        builder.CreateString(status_[BL_ALIGN]),
-        builder.CreateString(status_[BL_SCORE]),
-        builder.CreateString(status_[BL_CAP]),
-        builder.CreateString(status_[BL_GOLD]),
-        builder.CreateString(status_[BL_ENE]),
-        builder.CreateString(status_[BL_ENEMAX]), /* 7..12 */
-        builder.CreateString(status_[BL_XP]),
-        builder.CreateString(status_[BL_AC]),
-        builder.CreateString(status_[BL_HD]),
-        builder.CreateString(status_[BL_TIME]),
-        builder.CreateString(status_[BL_HUNGER]),
-        builder.CreateString(status_[BL_HP]),
-        builder.CreateString(status_[BL_HPMAX]),
-        builder.CreateString(status_[BL_LEVELDESC]),
-        builder.CreateString(status_[BL_EXP]), &fb_condition);
-
-    // NDArray for glyphs
-    const std::vector<int64_t> shape = { ROWNO, COLNO - 1 };
-    auto fb_shape = builder.CreateVector(shape);
-    auto fb_data =
-        builder.CreateVector(reinterpret_cast<uint8_t *>(glyphs_.data()),
-                             glyphs_.size() * sizeof(int16_t));
-    int dtype = 3; // np.dtype("int16").num == 3; np.typeDict[3] == np.int16
-    auto fb_glyphs =
-        nle::fbs::CreateNDArray(builder, fb_shape, dtype, fb_data);
-
-    // NDArray for chars
-    fb_shape = builder.CreateVector(shape);
-    dtype = 2; // np.dtype("uint8").num == 3; np.typeDict[3] == np.uint8
-    fb_data =
-        builder.CreateVector(chars_.data(), chars_.size() * sizeof(uint8_t));
+    flatbuffers::Offset<nle::fbs::Status> fb_status = 0;
+    if (observation_keys_ & OBS_STATUS)
+        fb_status = nle::fbs::CreateStatus(
+            builder, builder.CreateString(status_[BL_TITLE]),
+            builder.CreateString(status_[BL_STR]),
+            builder.CreateString(status_[BL_DX]),
+            builder.CreateString(status_[BL_CO]),
+            builder.CreateString(status_[BL_IN]),
+            builder.CreateString(status_[BL_WI]),
+            builder.CreateString(status_[BL_CH]), /* 1..6 */
+            builder.CreateString(status_[BL_ALIGN]),
+            builder.CreateString(status_[BL_SCORE]),
+            builder.CreateString(status_[BL_CAP]),
+            builder.CreateString(status_[BL_GOLD]),
+            builder.CreateString(status_[BL_ENE]),
+            builder.CreateString(status_[BL_ENEMAX]), /* 7..12 */
+            builder.CreateString(status_[BL_XP]),
+            builder.CreateString(status_[BL_AC]),
+            builder.CreateString(status_[BL_HD]),
+            builder.CreateString(status_[BL_TIME]),
+            builder.CreateString(status_[BL_HUNGER]),
+            builder.CreateString(status_[BL_HP]),
+            builder.CreateString(status_[BL_HPMAX]),
+            builder.CreateString(status_[BL_LEVELDESC]),
+            builder.CreateString(status_[BL_EXP]), &fb_condition);
+
+    // NDArrays for the map
+    static const int64_t shape[] = { ROWNO, COLNO - 1 };
+    auto ndarray = [&](const void *data, size_t size, int dtype) {
+        auto fb_shape = builder.CreateVector(shape, 2);
+        auto fb_data =
+            builder.CreateVector(static_cast<const uint8_t *>(data), size);
+        return nle::fbs::CreateNDArray(builder, fb_shape, dtype, fb_data);
+    };
+    // np.dtype("int16").num == 3, np.dtype("uint8").num == 2.
+    flatbuffers::Offset<nle::fbs::NDArray> fb_glyphs = 0, fb_chars = 0,
+                                           fb_colors = 0, fb_specials = 0;
+    if (observation_keys_ & OBS_GLYPHS)
+        fb_glyphs = ndarray(glyphs_.data(), glyphs_.size() * sizeof(int16_t),
+                            3);
     // TODO(heiner): Use gbuf instead, or drop glyphs entirely.
-    auto fb_chars =
-        nle::fbs::CreateNDArray(builder, fb_shape, dtype, fb_data);
-
-    // NDArray for colors
-    fb_shape = builder.CreateVector(shape);
-    dtype = 2; // np.dtype("uint8").num == 3; np.typeDict[3] == np.uint8
-    fb_data = builder.CreateVector(colors_.data(),
-                                   colors_.size() * sizeof(uint8_t));
-    auto fb_colors =
-        nle::fbs::CreateNDArray(builder, fb_shape, dtype, fb_data);
-
-    // NDArray for colors
-    fb_shape = builder.CreateVector(shape);
-    dtype = 2; // np.dtype("uint8").num == 3; np.typeDict[3] == np.uint8
-    fb_data = builder.CreateVector(specials_.data(),
-                                   specials_.size() * sizeof(uint8_t));
-    auto fb_specials =
-        nle::fbs::CreateNDArray(builder, fb_shape, dtype, fb_data);
+    if (observation_keys_ & OBS_CHARS)
+        fb_chars = ndarray(chars_.data(), chars_.size(), 2);
+    if (observation_keys_ & OBS_COLORS)
+        fb_colors = ndarray(colors_.data(), colors_.size(), 2);
+    if (observation_keys_ & OBS_SPECIALS)
+        fb_specials = ndarray(specials_.data(), specials_.size(), 2);
+
+    flatbuffers::Offset<nle::fbs::NDArray> fb_glyphs_crop = 0;
+    if (observation_keys_ & OBS_GLYPHS_CROP) {
+        const int64_t crop_shape[] = { crop_rows_, crop_cols_ };
+        fill_glyphs_crop(glyphs_crop_.data());
+        auto fb_shape = builder.CreateVector(crop_shape, 2);
+        auto fb_data = builder.CreateVector(
+            reinterpret_cast<const uint8_t *>(glyphs_crop_.data()),
+            crop_rows_ * crop_cols_ * sizeof(int16_t));
+        fb_glyphs_crop =
+            nle::fbs::CreateNDArray(builder, fb_shape, 3, fb_data);
+    }
 
     // Inventory
-    std::vector<flatbuffers::Offset<nle::fbs::InventoryItem> >
-        inventory_vector;
-
-    for (const rl_inventory_item &item : inventory_) {
-        auto fb_str = builder.CreateString(item.str);
-        auto fb_class_name = builder.CreateString(item.object_class_name);
-        auto fb_item = nle::fbs::CreateInventoryItem(
-            builder, item.glyph, fb_str, item.letter, item.object_class,
-            fb_class_name);
-        inventory_vector.push_back(fb_item);
+    flatbuffers::Offset<
+        flatbuffers::Vector<flatbuffers::Offset<nle::fbs::InventoryItem> > >
+        fb_inventory = 0;
+    if (observation_keys_ & OBS_INVENTORY) {
+        fb_inventory_.clear();
+        for (const rl_inventory_item &item : inventory_) {
+            auto fb_str = builder.CreateString(item.str);
+            auto fb_class_name = builder.CreateString(item.object_class_name);
+            auto fb_item = nle::fbs::CreateInventoryItem(
+                builder, item.glyph, fb_str, item.letter, item.object_class,
+                fb_class_name);
+            fb_inventory_.push_back(fb_item);
+        }
+        fb_inventory = builder.CreateVector(fb_inventory_);
     }
-    auto fb_inventory = builder.CreateVector(inventory_vector);
 
-    auto fb_observation =
-        nle::fbs::CreateObservation(builder, fb_glyphs, fb_chars, fb_colors,
-                                    fb_specials, fb_status, fb_inventory);
+    flatbuffers::Offset<nle::fbs::MapDelta> fb_map_delta = 0;
+    if (observation_keys_ & OBS_MAP_DELTA)
+        fb_map_delta = build_map_delta(builder);
 
-    // Blstats
-    int16_t hitpoints;
-
-    /* See botl.c. */
-    int i = Upolyd ? u.mh : u.uhp;
-    if (i < 0)
-        i = 0;
-
-    hitpoints = min(i, 9999);
-
-    int16_t max_hitpoints;
-    i = Upolyd ? u.mhmax : u.uhpmax;
-    max_hitpoints = min(i, 9999);
+    auto fb_observation = nle::fbs::CreateObservation(
+        builder, fb_glyphs, fb_chars, fb_colors, fb_specials, fb_status,
+        fb_inventory, fb_map_delta, fb_glyphs_crop);
 
+    // Blstats, filled in by getch_method()
     auto fb_blstats = nle::fbs::Blstats(
-        /* Cf. botl.c. */
-        u.ux - 1,            /* x coordinate, 1 <= ux <= cols */
-        u.uy,                /* y coordinate, 0 <= uy < rows */
-        ACURRSTR,            /* strength_percentage */
-        ACURR(A_STR),        /* strength          */
-        ACURR(A_DEX),        /* dexterity         */
-        ACURR(A_CON),        /* constitution      */
-        ACURR(A_INT),        /* intelligence      */
-        ACURR(A_WIS),        /* wisdom            */
-        ACURR(A_CHA),        /* charisma          */
-        botl_score(),        /* score             */
-        hitpoints,           /* hitpoints         */
-        max_hitpoints,       /* max_hitpoints     */
-        depth(&u.uz),        /* depth             */
-        money_cnt(invent),   /* gold              */
-        min(u.uen, 9999),    /* energy            */
-        min(u.uenmax, 9999), /* max_energy        */
-        u.uac,               /* armor_class       */
-        Upolyd ? (int) mons[u.umonnum].mlevel : 0, /* monster_level     */
-        u.ulevel,                                  /* experience_level  */
-        u.uexp,                                    /* experience_points */
-        moves,                                     /* time              */
-        u.uhs,                                     /* hunger state      */
-        near_capacity()                            /* carrying_capacity */
-    );
+        blstats_[NLE_BL_X], blstats_[NLE_BL_Y], blstats_[NLE_BL_STR25],
+        blstats_[NLE_BL_STR125], blstats_[NLE_BL_DEX], blstats_[NLE_BL_CON],
+        blstats_[NLE_BL_INT], blstats_[NLE_BL_WIS], blstats_[NLE_BL_CHA],
+        blstats_[NLE_BL_SCORE], blstats_[NLE_BL_HP], blstats_[NLE_BL_HPMAX],
+        blstats_[NLE_BL_DEPTH], blstats_[NLE_BL_GOLD], blstats_[NLE_BL_ENE],
+        blstats_[NLE_BL_ENEMAX], blstats_[NLE_BL_AC], blstats_[NLE_BL_HD],
+        blstats_[NLE_BL_XP], blstats_[NLE_BL_EXP], blstats_[NLE_BL_TIME],
+        blstats_[NLE_BL_HUNGER], blstats_[NLE_BL_CAP]);
 
     auto fb_you =
         nle::fbs::You(u.ux, u.uy, u.ux0, u.uy0, { u.uz.dnum, u.uz.dlevel },
@@ -446,8 +887,11 @@ NetHackRL::observation_message()
     if (program_state.gameover && killer.name[0] != 0)
         fb_killer_name = builder.CreateString(killer.name);
 
-    auto fb_call_stack = builder.CreateVectorOfStrings(
-        { win_proc_calls.begin(), win_proc_calls.end() });
+    fb_strings_.clear();
+    for (int i = 0;
+         i < std::min(win_proc_calls.depth, MAX_WIN_PROC_CALLS); ++i)
+        fb_strings_.push_back(builder.CreateString(win_proc_calls.calls[i]));
+    auto fb_call_stack = builder.CreateVector(fb_strings_);
 
     // From do.c. sstairs is a potential "special" staircase.
     boolean stairs_down =
@@ -463,10 +907,6 @@ NetHackRL::observation_message()
         fb_internal, &fb_program_state, &fb_seeds, false);
 
     builder.Finish(fb_response);
-
-    zmq::message_t reply(builder.GetSize());
-    memcpy(reply.data(), builder.GetBufferPointer(), builder.GetSize());
-    return reply;
 }
 
 void
@@ -478,12 +918,102 @@ NetHackRL::player_selection_method()
 int
 NetHackRL::getch_method()
 {
-    int action;
-    zmq::message_t request;
+    if (program_state.in_moveloop)
+        fill_blstats(blstats_.data());
+
+#ifdef NLE_LIB
+    fill_obs(nle_get_obs());
+    message_builder->Clear();
+    build_message(*message_builder);
+    nle_set_message(message_builder->GetBufferPointer(),
+                    message_builder->GetSize());
+#else
+    message_buffer &buffer = next_message_buffer();
+    build_message(buffer.builder);
+    send_message(buffer);
+#endif
+    message_unseen_ = false;
+#ifndef NLE_LIB
+    if (shm_action_ >= 0)
+        return action_nhgetch();
+#endif
+    return headless ? headless_nhgetch() : tty_nhgetch();
+}
+
+#ifndef NLE_LIB
+/* tty_nhgetch() with the key taken from NLE_SHM_ACTION, not the pty. */
+int
+NetHackRL::action_nhgetch()
+{
+    if (program_state.done_hup)
+        return '\033';
+    if (!headless) {
+        (void) fflush(stdout);
+        if (WIN_MESSAGE != WIN_ERR && wins[WIN_MESSAGE])
+            wins[WIN_MESSAGE]->flags &= ~WIN_STOP;
+    }
+
+    /* Requests for copies of the game only come in while it waits here. */
+    while (shm_control_ >= 0) {
+        struct pollfd fds[2] = { { shm_action_, POLLIN, 0 },
+                                 { shm_control_, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[0].revents)
+            break;
+        if (fds[1].revents & POLLIN) {
+            control();
+        } else {
+            close(shm_control_);
+            shm_control_ = -1;
+        }
+    }
+
+    int c = read_key(shm_action_);
+    if (c == EOF) {
+        /* Nobody left to send keys. Copies of the game have no pty that
+           would hang up on them, so do it here. */
+        hangup(0);
+        c = '\033';
+    } else if (c == 0) {
+        c = '\033';
+    }
+
+    if (!headless && ttyDisplay && ttyDisplay->toplin == 1)
+        ttyDisplay->toplin = 2;
+    return c;
+}
+
+/* Serves a request on NLE_CONTROL; in the copy, moves to its own NLE_SHM. */
+void
+NetHackRL::control()
+{
+    int r = nle_control(shm_control_);
+    if (r < 0) {
+        close(shm_control_);
+        shm_control_ = -1;
+    }
+    if (r <= 0)
+        return;
 
-    zmq_socket_.send(observation_message());
-    return tty_nhgetch();
+    close(shm_notify_);
+    close(shm_action_);
+    close(shm_control_);
+    munmap(shm_, sizeof(nle_shm));
+    shm_ = nullptr;
+    shm_action_ = shm_control_ = -1;
+    connect();
+
+    /* The copy's first message is the one the game was waiting on. */
+    since_keyframe_ = MAP_KEYFRAME_INTERVAL;
+    message_buffer &buffer = next_message_buffer();
+    build_message(buffer.builder);
+    send_message(buffer);
 }
+#endif
 
 void
 NetHackRL::update_inventory_method()
@@ -505,6 +1035,57 @@ NetHackRL::update_inventory_method()
     }
 }
 
+flatbuffers::Offset<nle::fbs::MapDelta>
+NetHackRL::build_map_delta(flatbuffers::FlatBufferBuilder &builder)
+{
+    bool keyframe = ++since_keyframe_ >= MAP_KEYFRAME_INTERVAL;
+
+    map_cells_.clear();
+    if (keyframe) {
+        since_keyframe_ = 0;
+        for (size_t i = 0; i < glyphs_.size(); ++i)
+            map_cells_.emplace_back(i, glyphs_[i], chars_[i], colors_[i],
+                                    specials_[i]);
+    } else {
+        for (uint16_t i : dirty_cells_)
+            map_cells_.emplace_back(i, glyphs_[i], chars_[i], colors_[i],
+                                    specials_[i]);
+    }
+    for (uint16_t i : dirty_cells_)
+        dirty_[i] = false;
+    dirty_cells_.clear();
+
+    return nle::fbs::CreateMapDelta(
+        builder, keyframe, builder.CreateVectorOfStructs(map_cells_));
+}
+
+void
+NetHackRL::remap_map()
+{
+    if (!remap_)
+        return;
+    map_glyphcells(glyphs_.data(), chars_.data(), colors_.data(),
+                   specials_.data());
+    for (size_t i = 0; i < printed_.size(); ++i) {
+        if (!printed_[i]) {
+            chars_[i] = ' ';
+            colors_[i] = 0;
+            specials_[i] = 0;
+        }
+        printed_[i] = false;
+    }
+    remap_ = false;
+}
+
+void
+NetHackRL::mark_dirty(size_t offset)
+{
+    if (!(observation_keys_ & OBS_MAP_DELTA) || dirty_[offset])
+        return;
+    dirty_[offset] = true;
+    dirty_cells_.push_back(offset);
+}
+
 void
 NetHackRL::store_glyph(XCHAR_P x, XCHAR_P y, int glyph)
 {
@@ -514,7 +1095,10 @@ NetHackRL::store_glyph(XCHAR_P x, XCHAR_P y, int glyph)
     size_t offset = j * (COLNO - 1) + i;
 
     // TODO: Glyphs might be taken from gbuf[y][x].glyph.
-    glyphs_[offset] = glyph;
+    if (glyphs_[offset] != (int16_t) glyph) {
+        glyphs_[offset] = glyph;
+        mark_dirty(offset);
+    }
 }
 
 void
@@ -526,9 +1110,13 @@ NetHackRL::store_mapped_glyph(int ch, int color, int special, XCHAR_P x,
     size_t j = y % ROWNO;
     size_t offset = j * (COLNO - 1) + i;
 
-    chars_[offset] = ch;
-    colors_[offset] = color;
-    specials_[offset] = special;
+    if (chars_[offset] != (uint8_t) ch || colors_[offset] != (uint8_t) color
+        || specials_[offset] != (uint8_t) special) {
+        chars_[offset] = ch;
+        colors_[offset] = color;
+        specials_[offset] = special;
+        mark_dirty(offset);
+    }
 }
 
 void
@@ -563,6 +1151,16 @@ NetHackRL::putstr_method(winid wid, int attr, const char *str)
 {
     DEBUG_API("About to set strings on " << wid << std::endl);
     windows_[wid]->strings.push_back(str);
+
+    if (headless && wid == WIN_MESSAGE) {
+        message_unseen_ = true;
+        if (!(attr & ATR_NOHISTORY)) {
+            msg_history_.push_back(str);
+            if (msg_history_.size() > (size_t) iflags.msg_history)
+                msg_history_.pop_front();
+            prev_message_ = 0;
+        }
+    }
 }
 
 winid
@@ -590,10 +1188,12 @@ NetHackRL::create_nhwindow_method(int type)
     DEBUG_API("rl_create_nhwindow(type=" << window_type << ")");
     ScopedStack s(win_proc_calls, "create_nhwindow");
 
-    winid wid = tty_create_nhwindow(type);
+    winid wid =
+        headless ? headless_create_nhwindow(type) : tty_create_nhwindow(type);
     DEBUG_API(": wid == " << wid << std::endl);
 
-    windows_.resize(wid + 1);
+    if (wid >= (winid) windows_.size())
+        windows_.resize(wid + 1);
     assert(!windows_[wid]);
 
     DEBUG_API("ABOUT TO RESET " << wid << std::endl;);
@@ -614,10 +1214,14 @@ NetHackRL::clear_nhwindow_method(winid wid)
         chars_.fill(' ');
         colors_.fill(0);
         specials_.fill(0);
+        printed_.fill(false);
+        remap_ = true;
+        since_keyframe_ = MAP_KEYFRAME_INTERVAL; /* everything changed */
     }
 
     DEBUG_API("rl_clear_nhwindow(wid=" << wid << ")" << std::endl);
-    tty_clear_nhwindow(wid);
+    if (!headless)
+        tty_clear_nhwindow(wid);
 }
 
 void
@@ -626,7 +1230,10 @@ NetHackRL::display_nhwindow_method(winid wid, BOOLEAN_P block)
     DEBUG_API("rl_display_nhwindow(wid=" << wid << ", block=" << block << ")"
                                          << std::endl);
 
-    tty_display_nhwindow(wid, block);
+    if (headless)
+        headless_display_nhwindow(wid, block);
+    else
+        tty_display_nhwindow(wid, block);
 }
 
 void
@@ -634,15 +1241,19 @@ NetHackRL::destroy_nhwindow_method(winid wid)
 {
     DEBUG_API("rl_destroy_nhwindow(wid=" << wid << ")" << std::endl);
     windows_[wid].reset(nullptr);
-    tty_destroy_nhwindow(wid);
+    if (!headless)
+        tty_destroy_nhwindow(wid);
 }
 
 void
 NetHackRL::start_menu_method(winid wid)
 {
     DEBUG_API("rl_start_menu(wid=" << wid << ")" << std::endl);
-    tty_start_menu(wid);
+    if (!headless)
+        tty_start_menu(wid);
     windows_[wid]->menu_items.clear();
+    if (headless)
+        windows_[wid]->strings.clear(); /* for headless_end_menu() */
 }
 
 void
@@ -658,7 +1269,9 @@ NetHackRL::add_menu_method(
 )
 {
     DEBUG_API("rl_add_menu" << std::endl);
-    tty_add_menu(wid, glyph, identifier, ch, gch, attr, str, preselected);
+    if (!headless)
+        tty_add_menu(wid, glyph, identifier, ch, gch, attr, str,
+                     preselected);
 
     /* We just add the menu item here. One problem with this method is that
        we won't see any updates happening during tty_select_menu. We could
@@ -668,13 +1281,527 @@ NetHackRL::add_menu_method(
         glyph, *identifier, -1L, str, attr, preselected, ch, gch });
 }
 
+void
+NetHackRL::headless_player_selection()
+{
+    /* tty_player_selection() without the menus: whatever wasn't set via
+       options or the player name is picked at random. */
+    rigid_role_checks();
+    if (flags.initrole < 0)
+        flags.initrole = randrole(FALSE);
+    if (flags.initrace < 0 || !validrace(flags.initrole, flags.initrace))
+        flags.initrace = randrace(flags.initrole);
+    if (flags.initgend < 0
+        || !validgend(flags.initrole, flags.initrace, flags.initgend))
+        flags.initgend = randgend(flags.initrole, flags.initrace);
+    if (flags.initalign < 0
+        || !validalign(flags.initrole, flags.initrace, flags.initalign))
+        flags.initalign = randalign(flags.initrole, flags.initrace);
+}
+
+winid
+NetHackRL::headless_create_nhwindow(int)
+{
+    winid wid = 1; /* 0 is BASE_WINDOW */
+    while (wid < (winid) windows_.size() && windows_[wid])
+        ++wid;
+    return wid;
+}
+
+/* tty's --More--: space, enter or escape continues. */
+int
+NetHackRL::headless_wait()
+{
+    int c;
+
+    xwaitingforspace = true;
+    do {
+        c = nhgetch();
+    } while (c != ' ' && c != '\n' && c != '\r' && c != '\033'
+             && c != EOF && !program_state.done_hup);
+    xwaitingforspace = false;
+    return c;
+}
+
+void
+NetHackRL::headless_display_nhwindow(winid wid, BOOLEAN_P block)
+{
+    rl_window *win = windows_[wid].get();
+
+    switch (win->type) {
+    case NHW_MESSAGE:
+        if (message_unseen_) {
+            headless_wait();
+            win->strings.clear();
+        }
+        message_unseen_ = false;
+        iflags.window_inited = TRUE;
+        break;
+    case NHW_MAP:
+        if (block) {
+            message_unseen_ = true; /* tty always asks here */
+            headless_display_nhwindow(WIN_MESSAGE, TRUE);
+        }
+        break;
+    case NHW_TEXT:
+    case NHW_MENU:
+        /* As in tty, showing these always waits for a dismissal. */
+        if (message_unseen_)
+            headless_display_nhwindow(WIN_MESSAGE, TRUE);
+        headless_wait();
+        break;
+    }
+}
+
+/* Item i of a menu window starts on this page. */
+static int
+menu_page(size_t first_line, size_t i)
+{
+    return (first_line + i) / HEADLESS_MENU_PAGE;
+}
+
+void
+NetHackRL::headless_end_menu(winid wid, const char *prompt)
+{
+    rl_window *win = windows_[wid].get();
+
+    /* tty puts the prompt and a blank line on top of the menu. */
+    if (prompt && *prompt)
+        win->strings.assign(1, prompt);
+    size_t first_line = win->strings.empty() ? 0 : 2;
+
+    /* Selectors run a..z, A..Z and start over on each page, as in tty. */
+    char next = 'a';
+    int page = 0;
+    for (size_t i = 0; i < win->menu_items.size(); ++i) {
+        rl_menu_item &item = win->menu_items[i];
+        if (menu_page(first_line, i) != page) {
+            page = menu_page(first_line, i);
+            next = 'a';
+        }
+        if (!item.identifier.a_void || item.selector || !next)
+            continue;
+        item.selector = next;
+        next = (next == 'z') ? 'A' : (next == 'Z') ? 0 : next + 1;
+    }
+}
+
+int
+NetHackRL::headless_select_menu(winid wid, int how, menu_item **menu_list)
+{
+    std::vector<rl_menu_item> &items = windows_[wid]->menu_items;
+    size_t first_line = windows_[wid]->strings.empty() ? 0 : 2;
+    int last_page = items.empty() ? 0 : menu_page(first_line, items.size() - 1);
+    int page = 0;
+    long count = 0;
+    bool counting = false, finished = false, cancelled = false;
+
+    *menu_list = nullptr;
+
+    if (message_unseen_)
+        headless_display_nhwindow(WIN_MESSAGE, TRUE);
+
+    auto on_page = [&](size_t i) { return menu_page(first_line, i) == page; };
+    auto selectable = [&](const rl_menu_item &item) {
+        return item.identifier.a_void != 0;
+    };
+    /* toggle_menu_curr() in wintty.c */
+    auto toggle = [&](rl_menu_item &item) {
+        if (counting && count > 0) {
+            item.count = count;
+            item.selected = TRUE;
+        } else if (item.selected) {
+            item.selected = FALSE;
+            item.count = -1L;
+        } else if (!counting) {
+            item.selected = TRUE;
+        }
+    };
+
+    xwaitingforspace = true;
+    while (!finished) {
+        int c = nhgetch();
+        if (c == EOF || program_state.done_hup) {
+            cancelled = true;
+            break;
+        }
+
+        /* Selectors on this page and group accelerators come first. */
+        bool matched = false;
+        if (how != PICK_NONE && c != '\033' && c != '\n' && c != '\r') {
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (on_page(i) && selectable(items[i])
+                    && items[i].selector == c) {
+                    if (how == PICK_ONE)
+                        for (rl_menu_item &item : items)
+                            item.selected = FALSE;
+                    toggle(items[i]);
+                    matched = true;
+                    break;
+                }
+            }
+            if (!matched && !(counting && digit(c))) {
+                for (rl_menu_item &item : items) {
+                    if (!selectable(item) || item.gselector != c
+                        || (how == PICK_ONE && matched))
+                        continue;
+                    toggle(item);
+                    matched = true;
+                }
+            }
+        }
+        if (matched) {
+            counting = false;
+            count = 0;
+            if (how == PICK_ONE)
+                finished = true;
+            continue;
+        }
+
+        c = map_menu_cmd(c);
+        if (how != PICK_NONE && digit(c)) {
+            count = 10 * count + (c - '0');
+            if (count)
+                counting = true;
+            continue;
+        }
+        switch (c) {
+        case '\033':
+            if (!counting) {
+                for (rl_menu_item &item : items) {
+                    item.selected = FALSE;
+                    item.count = -1L;
+                }
+                cancelled = finished = true;
+            }
+            break;
+        case '\n':
+        case '\r':
+            if (how != PICK_NONE) {
+                finished = true;
+                break;
+            }
+            /*FALLTHRU*/
+        case ' ':
+        case MENU_NEXT_PAGE:
+            if (page < last_page)
+                ++page;
+            else if (c == ' ' || how == PICK_NONE)
+                finished = true;
+            break;
+        case MENU_PREVIOUS_PAGE:
+            if (page > 0)
+                --page;
+            break;
+        case MENU_FIRST_PAGE:
+            page = 0;
+            break;
+        case MENU_LAST_PAGE:
+            page = last_page;
+            break;
+        case MENU_SELECT_PAGE:
+        case MENU_SELECT_ALL:
+        case MENU_INVERT_PAGE:
+        case MENU_INVERT_ALL:
+            if (how != PICK_ANY)
+                break;
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (!selectable(items[i]))
+                    continue;
+                if (c == MENU_SELECT_PAGE || c == MENU_INVERT_PAGE)
+                    if (!on_page(i))
+                        continue;
+                if (c == MENU_SELECT_PAGE || c == MENU_SELECT_ALL) {
+                    items[i].selected = TRUE;
+                } else {
+                    items[i].selected = !items[i].selected;
+                    items[i].count = -1L;
+                }
+            }
+            break;
+        case MENU_UNSELECT_PAGE:
+        case MENU_UNSELECT_ALL:
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (c == MENU_UNSELECT_PAGE && !on_page(i))
+                    continue;
+                items[i].selected = FALSE;
+                items[i].count = -1L;
+            }
+            break;
+        default:
+            break;
+        }
+        counting = false;
+        count = 0;
+    }
+    xwaitingforspace = false;
+
+    if (cancelled)
+        return -1;
+
+    int n = 0;
+    for (const rl_menu_item &item : items)
+        n += item.selected ? 1 : 0;
+    if (n > 0) {
+        menu_item *mi = *menu_list = (menu_item *) alloc(n * sizeof(menu_item));
+        for (const rl_menu_item &item : items) {
+            if (!item.selected)
+                continue;
+            mi->item = item.identifier;
+            mi->count = item.count;
+            ++mi;
+        }
+    }
+    return n;
+}
+
+/* As tty_yn_function(), see the comment there. */
+char
+NetHackRL::headless_yn_function(const char *question, const char *choices,
+                                char def)
+{
+    char prompt[BUFSZ];
+    bool allow_num = false, preserve_case = false;
+    char q;
+
+    yn_number = 0L;
+    if (message_unseen_)
+        headless_display_nhwindow(WIN_MESSAGE, TRUE);
+
+    if (!choices) {
+        Sprintf(prompt, "%s ", question);
+        custompline(OVERRIDE_MSGTYPE | SUPPRESS_HISTORY, "%s", prompt);
+        return readchar();
+    }
+
+    char respbuf[QBUFSZ];
+    allow_num = strchr(choices, '#') != nullptr;
+    (void) strncpy(respbuf, choices, QBUFSZ - 1);
+    respbuf[QBUFSZ - 1] = '\0';
+    for (const char *rb = respbuf; *rb; ++rb)
+        if ('A' <= *rb && *rb <= 'Z') {
+            preserve_case = true;
+            break;
+        }
+    if (char *rb = strchr(respbuf, '\033'))
+        *rb = '\0';
+    (void) strncpy(prompt, question, QBUFSZ - 1);
+    prompt[QBUFSZ - 1] = '\0';
+    Sprintf(eos(prompt), " [%s]", respbuf);
+    if (def)
+        Sprintf(eos(prompt), " (%c)", def);
+    Strcat(prompt, " ");
+    custompline(OVERRIDE_MSGTYPE | SUPPRESS_HISTORY, "%s", prompt);
+
+    do {
+        q = readchar();
+        if (!preserve_case)
+            q = lowc(q);
+        if (q == '\020') { /* ctrl-P */
+            (void) headless_doprev_message();
+            q = '\0';
+            continue;
+        }
+        bool digit_ok = allow_num && digit(q);
+        if (q == '\033') {
+            if (strchr(choices, 'q'))
+                q = 'q';
+            else if (strchr(choices, 'n'))
+                q = 'n';
+            else
+                q = def;
+            break;
+        } else if (strchr(quitchars, q)) {
+            q = def;
+            break;
+        }
+        if (!strchr(choices, q) && !digit_ok) {
+            q = '\0';
+        } else if (q == '#' || digit_ok) {
+            long value = (q == '#') ? 0 : q - '0';
+            char z;
+
+            q = '#';
+            for (;;) {
+                z = readchar();
+                if (!preserve_case)
+                    z = lowc(z);
+                if (digit(z)) {
+                    value = 10 * value + (z - '0');
+                    if (value < 0)
+                        break; /* overflow: try again */
+                } else if (z == 'y' || strchr(quitchars, z)) {
+                    if (z == '\033')
+                        value = -1;
+                    break;
+                } else {
+                    value = -1;
+                    break;
+                }
+            }
+            if (value > 0)
+                yn_number = value;
+            else if (value == 0)
+                q = 'n'; /* 0 => "no" */
+            else
+                q = '\0';
+        }
+    } while (!q);
+
+    return q;
+}
+
+/* As hooked_tty_getlin() in getline.c, without the autocompletion. */
+void
+NetHackRL::headless_getlin(const char *prompt, char *line)
+{
+    std::string buf;
+
+    if (message_unseen_)
+        headless_display_nhwindow(WIN_MESSAGE, TRUE);
+    custompline(OVERRIDE_MSGTYPE | SUPPRESS_HISTORY, "%s ", prompt);
+
+    for (;;) {
+        /* Show what was typed so far, as tty does on the top line. */
+        windows_[WIN_MESSAGE]->strings.assign(
+            1, std::string(prompt) + " " + buf);
+
+        int c = pgetchar();
+        if (c == '\033' || c == EOF) {
+            if (c == '\033' && !buf.empty()) {
+                buf.clear();
+                continue;
+            }
+            Strcpy(line, "\033");
+            return;
+        }
+        if (c == '\b' || c == '\177') {
+            if (!buf.empty())
+                buf.pop_back();
+        } else if (c == '\025') { /* ctrl-U */
+            buf.clear();
+        } else if (c == '\n' || c == '\r') {
+            break;
+        } else if (' ' <= (unsigned char) c && c != '\177'
+                   && buf.size() < BUFSZ - 1 && buf.size() < COLNO) {
+            buf.push_back(c);
+        }
+    }
+    Strcpy(line, buf.c_str());
+}
+
+/* As tty_get_ext_cmd(): typed commands may be abbreviated as long as
+   the abbreviation is unique among the autocompleting ones. */
+int
+NetHackRL::headless_get_ext_cmd()
+{
+    char buf[BUFSZ];
+    int i, match = -1;
+
+    headless_getlin("#", buf);
+    (void) mungspaces(buf);
+    if (buf[0] == '\0' || buf[0] == '\033')
+        return -1;
+
+    for (i = 0; extcmdlist[i].ef_txt; ++i)
+        if (!strcmpi(buf, extcmdlist[i].ef_txt))
+            return i;
+
+    for (i = 0; extcmdlist[i].ef_txt; ++i) {
+        if (!(extcmdlist[i].flags & AUTOCOMPLETE))
+            continue;
+        if (!flags.debug && (extcmdlist[i].flags & WIZMODECMD))
+            continue;
+        if (strncmpi(buf, extcmdlist[i].ef_txt, strlen(buf)))
+            continue;
+        if (match >= 0) {
+            match = -1; /* ambiguous */
+            break;
+        }
+        match = i;
+    }
+    if (match < 0)
+        pline("%s: unknown extended command.", buf);
+    return match;
+}
+
+/* Each call shows the next older message, as tty's msg_window:single. */
+int
+NetHackRL::headless_doprev_message()
+{
+    if (msg_history_.empty())
+        return 0;
+    prev_message_ = prev_message_ % msg_history_.size() + 1;
+    windows_[WIN_MESSAGE]->strings.assign(
+        1, msg_history_[msg_history_.size() - prev_message_]);
+    return 0;
+}
+
+void
+NetHackRL::headless_display_file(const char *filename, bool must_exist)
+{
+    dlb *f = dlb_fopen(filename, "r");
+    char buf[BUFSZ];
+
+    if (!f) {
+        if (must_exist)
+            pline("Cannot open \"%s\".", filename);
+        return;
+    }
+    winid wid = create_nhwindow(NHW_TEXT);
+    while (dlb_fgets(buf, sizeof buf, f)) {
+        if (char *nl = strchr(buf, '\n'))
+            *nl = '\0';
+        putstr(wid, 0, buf);
+    }
+    (void) dlb_fclose(f);
+    display_nhwindow(wid, TRUE);
+    destroy_nhwindow(wid);
+}
+
+char *
+NetHackRL::headless_getmsghistory(bool init)
+{
+    if (init)
+        msg_history_next_ = 0;
+    if (msg_history_next_ >= msg_history_.size())
+        return nullptr;
+    return const_cast<char *>(msg_history_[msg_history_next_++].c_str());
+}
+
+void
+NetHackRL::headless_putmsghistory(const char *msg)
+{
+    if (!msg) /* end of a restore */
+        return;
+    msg_history_.push_back(msg);
+    if (msg_history_.size() > (size_t) iflags.msg_history)
+        msg_history_.pop_front();
+}
+
 void
 NetHackRL::rl_init_nhwindows(int *argc, char **argv)
 {
     DEBUG_API("rl_init_nhwindows" << std::endl);
     ScopedStack s(win_proc_calls, "init_nhwindows");
+    const char *env = nh_getenv("NLE_HEADLESS");
+    headless = env && *env && strcmp(env, "0");
     instance = std::make_unique<NetHackRL>(*argc, argv);
-    tty_init_nhwindows(argc, argv);
+    if (!headless) {
+        tty_init_nhwindows(argc, argv);
+        return;
+    }
+#ifndef NLE_LIB
+    /* No tty port to do this: keys arrive one by one and unchanged. */
+    struct termios t;
+    if (tcgetattr(fileno(stdin), &t) == 0) {
+        t.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        t.c_iflag &= ~(ICRNL | INLCR | IXON);
+        t.c_cc[VMIN] = 1;
+        t.c_cc[VTIME] = 0;
+        (void) tcsetattr(fileno(stdin), TCSANOW, &t);
+    }
+#endif
 }
 
 void
@@ -682,7 +1809,10 @@ NetHackRL::rl_player_selection()
 {
     DEBUG_API("rl_player_selection" << std::endl);
     ScopedStack s(win_proc_calls, "player_selection");
-    tty_player_selection();
+    if (headless)
+        instance->headless_player_selection();
+    else
+        tty_player_selection();
     instance->player_selection_method();
 }
 
@@ -691,7 +1821,10 @@ NetHackRL::rl_askname()
 {
     DEBUG_API("rl_askname" << std::endl);
     ScopedStack s(win_proc_calls, "askname");
-    tty_askname();
+    if (!headless)
+        tty_askname();
+    else if (!*plname)
+        (void) strncpy(plname, "Agent", sizeof plname - 1);
 }
 
 void
@@ -699,7 +1832,8 @@ NetHackRL::rl_get_nh_event()
 {
     DEBUG_API("rl_get_nh_event" << std::endl);
     ScopedStack s(win_proc_calls, "get_nh_event");
-    tty_get_nh_event();
+    if (!headless)
+        tty_get_nh_event();
 }
 
 void
@@ -708,7 +1842,10 @@ NetHackRL::rl_exit_nhwindows(const char *c)
     DEBUG_API("rl_exit_nhwindows" << std::endl);
     ScopedStack s(win_proc_calls, "exit_nhwindows");
     instance.reset(nullptr);
-    tty_exit_nhwindows(c);
+    if (!headless)
+        tty_exit_nhwindows(c);
+    else if (c && *c)
+        rl_raw_print(c);
 }
 
 void
@@ -716,7 +1853,8 @@ NetHackRL::rl_suspend_nhwindows(const char *c)
 {
     DEBUG_API("rl_suspend_nhwindows" << std::endl);
     ScopedStack s(win_proc_calls, "suspend_nhwindows");
-    tty_suspend_nhwindows(c);
+    if (!headless)
+        tty_suspend_nhwindows(c);
 }
 
 void
@@ -724,7 +1862,8 @@ NetHackRL::rl_resume_nhwindows()
 {
     DEBUG_API("rl_resume_nhwindows" << std::endl);
     ScopedStack s(win_proc_calls, "resume_nhwindows");
-    tty_resume_nhwindows();
+    if (!headless)
+        tty_resume_nhwindows();
 }
 
 winid
@@ -771,7 +1910,8 @@ NetHackRL::rl_curs(winid wid, int x, int y)
                              << std::endl);
     ScopedStack s(win_proc_calls, "curs");
     DEBUG_API("rl_curs for window id " << wid << std::endl);
-    tty_curs(wid, x, y);
+    if (!headless)
+        tty_curs(wid, x, y);
 }
 
 void
@@ -781,7 +1921,8 @@ NetHackRL::rl_putstr(winid wid, int attr, const char *text)
                                << ", text=" << text << ")" << std::endl);
     ScopedStack s(win_proc_calls, "putstr");
     instance->putstr_method(wid, attr, text);
-    tty_putstr(wid, attr, text);
+    if (!headless)
+        tty_putstr(wid, attr, text);
 }
 
 void
@@ -789,7 +1930,10 @@ NetHackRL::rl_display_file(const char *filename, BOOLEAN_P must_exist)
 {
     DEBUG_API("rl_display_file" << std::endl);
     ScopedStack s(win_proc_calls, "display_file");
-    tty_display_file(filename, must_exist);
+    if (headless)
+        instance->headless_display_file(filename, must_exist);
+    else
+        tty_display_file(filename, must_exist);
 }
 
 void
@@ -814,7 +1958,10 @@ NetHackRL::rl_end_menu(winid wid, const char *prompt)
 {
     DEBUG_API("rl_end_menu" << std::endl);
     ScopedStack s(win_proc_calls, "end_menu");
-    tty_end_menu(wid, prompt);
+    if (headless)
+        instance->headless_end_menu(wid, prompt);
+    else
+        tty_end_menu(wid, prompt);
 }
 
 int
@@ -822,7 +1969,9 @@ NetHackRL::rl_select_menu(winid wid, int how, MENU_ITEM_P **menu_list)
 {
     DEBUG_API("rl_select_menu");
     ScopedStack s(win_proc_calls, "select_menu");
-    int response = tty_select_menu(wid, how, menu_list);
+    int response = headless
+                       ? instance->headless_select_menu(wid, how, menu_list)
+                       : tty_select_menu(wid, how, menu_list);
     DEBUG_API(" : " << response << std::endl);
     return response;
 }
@@ -840,7 +1989,8 @@ NetHackRL::rl_mark_synch()
 {
     DEBUG_API("rl_mark_synch" << std::endl);
     ScopedStack s(win_proc_calls, "mark_synch");
-    tty_mark_synch();
+    if (!headless)
+        tty_mark_synch();
 }
 
 void
@@ -848,14 +1998,16 @@ NetHackRL::rl_wait_synch()
 {
     DEBUG_API("rl_wait_synch" << std::endl);
     ScopedStack s(win_proc_calls, "wait_synch");
-    tty_wait_synch();
+    if (!headless)
+        tty_wait_synch();
 }
 
 void
 NetHackRL::rl_cliparound(int x, int y)
 {
 #ifdef CLIPPING
-    tty_cliparound(x, y);
+    if (!headless)
+        tty_cliparound(x, y);
 #endif
 }
 
@@ -877,7 +2029,16 @@ NetHackRL::rl_print_glyph(winid wid, XCHAR_P x, XCHAR_P y, int glyph,
     int color;
     unsigned special;
 
-    (void) mapglyph(glyph, &ch, &color, &special, x, y, 0);
+    if (wid == WIN_MAP && instance->remap_) {
+        /* the whole map is being redrawn, see remap_map() */
+        instance->store_glyph(x, y, glyph);
+        instance->printed_[y % ROWNO * (COLNO - 1) + (x - 1) % (COLNO - 1)] =
+            true;
+        if (!headless)
+            tty_print_glyph(wid, x, y, glyph, bkglyph);
+        return;
+    }
+    map_glyphcell(glyph, &ch, &color, &special, x, y);
 #if USE_DEBUG_API
     DEBUG_API("rl_print_glyph(wid=" << wid << ", x=" << x << ", y=" << y
                                     << ", glyph=(ch='" << (char) ch
@@ -898,14 +2059,21 @@ NetHackRL::rl_print_glyph(winid wid, XCHAR_P x, XCHAR_P y, int glyph,
                                   << std::endl);
     }
 
-    tty_print_glyph(wid, x, y, glyph, bkglyph);
+    if (!headless)
+        tty_print_glyph(wid, x, y, glyph, bkglyph);
 }
 void
 NetHackRL::rl_raw_print(const char *str)
 {
     DEBUG_API("rl_raw_print" << std::endl);
     ScopedStack s(win_proc_calls, "raw_print");
-    tty_raw_print(str);
+    if (headless) {
+        fputs(str, stdout);
+        fputc('\n', stdout);
+        fflush(stdout);
+    } else {
+        tty_raw_print(str);
+    }
 }
 
 void
@@ -913,7 +2081,10 @@ NetHackRL::rl_raw_print_bold(const char *str)
 {
     DEBUG_API("rl_raw_print_bold" << std::endl);
     ScopedStack s(win_proc_calls, "raw_bold_print");
-    tty_raw_print_bold(str);
+    if (headless)
+        rl_raw_print(str);
+    else
+        tty_raw_print_bold(str);
 }
 
 int
@@ -945,7 +2116,8 @@ NetHackRL::rl_nhbell()
 {
     DEBUG_API("rl_nhbell" << std::endl);
     ScopedStack s(win_proc_calls, "nhbell");
-    return tty_nhbell();
+    if (!headless)
+        tty_nhbell();
 }
 
 int
@@ -953,7 +2125,8 @@ NetHackRL::rl_doprev_message()
 {
     DEBUG_API("rl_doprev_message" << std::endl);
     ScopedStack s(win_proc_calls, "doprev_message");
-    int result = tty_doprev_message();
+    int result = headless ? instance->headless_doprev_message()
+                          : tty_doprev_message();
     return result;
 }
 
@@ -963,7 +2136,9 @@ NetHackRL::rl_yn_function(const char *question_, const char *choices,
 {
     DEBUG_API("rl_yn_function" << std::endl);
     ScopedStack s(win_proc_calls, "yn_function");
-    char result = tty_yn_function(question_, choices, def);
+    char result =
+        headless ? instance->headless_yn_function(question_, choices, def)
+                 : tty_yn_function(question_, choices, def);
     return result;
 }
 
@@ -972,7 +2147,10 @@ NetHackRL::rl_getlin(const char *prompt, char *line)
 {
     DEBUG_API("rl_getlin" << std::endl);
     ScopedStack s(win_proc_calls, "getlin");
-    tty_getlin(prompt, line);
+    if (headless)
+        instance->headless_getlin(prompt, line);
+    else
+        tty_getlin(prompt, line);
 }
 
 int
@@ -980,7 +2158,7 @@ NetHackRL::rl_get_ext_cmd()
 {
     DEBUG_API("rl_get_ext_cmd" << std::endl);
     ScopedStack s(win_proc_calls, "get_ext_cmd");
-    return tty_get_ext_cmd();
+    return headless ? instance->headless_get_ext_cmd() : tty_get_ext_cmd();
 }
 
 void
@@ -988,7 +2166,8 @@ NetHackRL::rl_number_pad(int i)
 {
     DEBUG_API("rl_number_pad" << std::endl);
     ScopedStack s(win_proc_calls, "number_pad");
-    tty_number_pad(i);
+    if (!headless)
+        tty_number_pad(i);
 }
 
 void
@@ -1003,7 +2182,8 @@ NetHackRL::rl_start_screen()
 {
     DEBUG_API("rl_start_screen" << std::endl);
     ScopedStack s(win_proc_calls, "start_screen");
-    tty_start_screen();
+    if (!headless)
+        tty_start_screen();
 }
 
 void
@@ -1011,7 +2191,8 @@ NetHackRL::rl_end_screen()
 {
     DEBUG_API("rl_end_screen" << std::endl);
     ScopedStack s(win_proc_calls, "end_screen");
-    tty_end_screen();
+    if (!headless)
+        tty_end_screen();
 
     if (instance)
         // The only way instance can still be around is in an error situation.
@@ -1031,6 +2212,8 @@ char *
 NetHackRL::rl_getmsghistory(BOOLEAN_P init)
 {
     DEBUG_API("rl_getmsghistory" << std::endl);
+    if (headless)
+        return instance ? instance->headless_getmsghistory(init) : nullptr;
     return tty_getmsghistory(init);
 }
 
@@ -1038,7 +2221,10 @@ void
 NetHackRL::rl_putmsghistory(const char *msg, BOOLEAN_P is_restoring)
 {
     DEBUG_API("rl_putmsghistory" << std::endl);
-    tty_putmsghistory(msg, is_restoring);
+    if (!headless)
+        tty_putmsghistory(msg, is_restoring);
+    else if (instance)
+        instance->headless_putmsghistory(msg);
 }
 
 void
@@ -1046,7 +2232,10 @@ NetHackRL::rl_status_init()
 {
     DEBUG_API("rl_status_init" << std::endl);
     ScopedStack s(win_proc_calls, "status_init");
-    tty_status_init();
+    if (headless)
+        genl_status_init();
+    else
+        tty_status_init();
 }
 
 void
@@ -1059,7 +2248,8 @@ NetHackRL::rl_status_update(int fldidx, genericptr_t ptr, int chg,
     instance->status_update_method(fldidx, ptr, chg, percent, color,
                                    colormasks);
 #ifdef STATUS_HILITES
-    tty_status_update(fldidx, ptr, chg, percent, color, colormasks);
+    if (!headless)
+        tty_status_update(fldidx, ptr, chg, percent, color, colormasks);
 #endif
 }
 
@@ -1068,12 +2258,42 @@ rl_update_positionbar(char *chrs)
 {
     DEBUG_API("rl_update_positionbar" << std::endl);
 #ifdef POSITIONBAR
-    tty_update_positionbar(chrs);
+    if (!headless)
+        tty_update_positionbar(chrs);
 #endif
 }
 
+static void
+rl_preference_update(const char *pref)
+{
+    if (headless)
+        genl_preference_update(pref);
+    else
+        tty_preference_update(pref);
+}
+
+static void
+rl_status_enablefield(int fieldidx, const char *nm, const char *fmt,
+                      BOOLEAN_P enable)
+{
+    if (headless)
+        genl_status_enablefield(fieldidx, nm, fmt, enable);
+    else
+        tty_status_enablefield(fieldidx, nm, fmt, enable);
+}
+
 } // namespace nethack_rl
 
+#ifdef NLE_LIB
+void
+nle_rl_free(void)
+{
+    nethack_rl::message_builder.reset(nullptr);
+    /* calls left on the stack of a game nle_end() abandoned */
+    nethack_rl::win_proc_calls.depth = 0;
+}
+#endif
+
 struct window_procs rl_procs = {
     "rl",
     (WC_COLOR | WC_HILITE_PET | WC_INVERSE | WC_EIGHT_BIT_IN
@@ -1145,12 +2365,12 @@ struct window_procs rl_procs = {
 #else
     genl_outrip,
 #endif
-    tty_preference_update,
+    nethack_rl::rl_preference_update,
     nethack_rl::NetHackRL::rl_getmsghistory,
     nethack_rl::NetHackRL::rl_putmsghistory,
     nethack_rl::NetHackRL::rl_status_init,
     genl_status_finish,
-    tty_status_enablefield,
+    nethack_rl::rl_status_enablefield,
     nethack_rl::NetHackRL::rl_status_update,
     genl_can_suspend_yes,
 };
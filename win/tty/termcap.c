@@ -10,6 +10,14 @@
 #include "wintty.h"
 #include "tcap.h"
 
+#ifdef NLE_LIB
+/* The in-process library always draws for an ANSI terminal of a fixed
+   size and stays away from the terminfo database, whose tgoto() returns
+   a buffer shared by every game in the process. */
+#undef TERMLIB
+#define ANSI_DEFAULT
+#endif
+
 #ifdef MICROPORT_286_BUG
 #define Tgetstr(key) (tgetstr(key, tbuf))
 #else
@@ -124,6 +132,10 @@ int *wid, *hgt;
         if (CO < COLNO || LI < ROWNO + 3)
             setclipped();
 #endif
+#endif
+#ifdef NLE_LIB
+        CO = NLE_TERM_CO;
+        LI = NLE_TERM_LI;
 #endif
         HO = "\033[H";
         /*              nh_CD = "\033[J"; */
@@ -401,7 +401,7 @@ char **argv UNUSED;
      *  tty_startup() must be called before initoptions()
      *    due to ordering of graphics settings
      */
-#if defined(UNIX) || defined(VMS)
+#if (defined(UNIX) || defined(VMS)) && !defined(NLE_LIB)
     setbuf(stdout, obuf);
 #endif
     gettty();
@@ -429,7 +429,8 @@ char **argv UNUSED;
 
     ttyDisplay->lastwin = WIN_ERR;
 
-#if defined(SIGWINCH) && defined(CLIPPING) && !defined(NO_SIGNAL)
+#if defined(SIGWINCH) && defined(CLIPPING) && !defined(NO_SIGNAL) \
+    && !defined(NLE_LIB)
     (void) signal(SIGWINCH, (SIG_RET_TYPE) winch_handler);
 #endif
 
@@ -3482,7 +3483,7 @@ int
 tty_nhgetch()
 {
     int i;
-#ifdef UNIX
+#if defined(UNIX) && !defined(NLE_LIB)
     /* kludge alert: Some Unix variants return funny values if getc()
      * is called, interrupted, and then called again.  There
      * is non-reentrant code in the internal _filbuf() routine, called by
@@ -3505,7 +3506,9 @@ tty_nhgetch()
     if (iflags.debug_fuzzer) {
         i = randomkey();
     } else {
-#ifdef UNIX
+#ifdef NLE_LIB
+        i = nle_getch(); /* the key passed to nle_step() */
+#elif defined(UNIX)
         i = (++nesting == 1)
               ? tgetch()
               : (read(fileno(stdin), (genericptr_t) &nestbuf, 1) == 1)